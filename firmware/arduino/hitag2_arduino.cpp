@@ -16,6 +16,17 @@ static Token tokens[MAX_TOKENS];
 static int selected_token_index = -1;
 static bool emulation_active = false;
 
+// Delta sync with the PIC32 (SAVE_TOKEN_DELTA): the PIC32 boot epoch
+// and generation of the last sync (generation 0: pull every page). The
+// Flipper is served from the bridge's own counter, bumped by every sync
+// that changed a page, so PIC32 restarts and token selects never move
+// it backwards; page_generation holds its value at each page's change.
+#define NUM_PAGES 8
+static uint32_t pic_epoch = 0;
+static uint32_t pic_generation = 0;
+static uint32_t sync_generation = 0;
+static uint32_t page_generation[NUM_PAGES];
+
 // Command callbacks
 typedef void (*CommandCallback)(const uint8_t* data, uint8_t len, uint8_t* response, uint8_t* response_len);
 
@@ -123,6 +134,162 @@ Token create_default_token() {
     return token;
 }
 
+/*
+ * Read a token field as the PIC32 page it is stored in
+ * Page 3 carries key bytes 4-5 in its upper half; the password in its
+ * lower half is not kept here.
+ */
+uint32_t token_get_page(const Token* token, uint8_t page) {
+    switch (page) {
+        case 0: return token->uid;
+        case 1: return token->config;
+        case 2: return ((uint32_t)token->key[0]) |
+                       ((uint32_t)token->key[1] << 8) |
+                       ((uint32_t)token->key[2] << 16) |
+                       ((uint32_t)token->key[3] << 24);
+        case 3: return ((uint32_t)token->key[4] << 16) |
+                       ((uint32_t)token->key[5] << 24);
+        default: return token->user_data[page - 4];
+    }
+}
+
+/*
+ * Write a PIC32 page into the token fields
+ */
+void token_set_page(Token* token, uint8_t page, uint32_t data) {
+    switch (page) {
+        case 0: token->uid = data; break;
+        case 1: token->config = data; break;
+        case 2:
+            token->key[0] = data & 0xFF;
+            token->key[1] = (data >> 8) & 0xFF;
+            token->key[2] = (data >> 16) & 0xFF;
+            token->key[3] = (data >> 24) & 0xFF;
+            break;
+        case 3:
+            token->key[4] = (data >> 16) & 0xFF;
+            token->key[5] = (data >> 24) & 0xFF;
+            break;
+        default: token->user_data[page - 4] = data; break;
+    }
+}
+
+/*
+ * Bring the selected token up to date with the PIC32
+ * Only the pages changed since the last sync cross SPI. If the PIC32
+ * booted again since (new epoch) its generations restarted and the
+ * mask cannot be trusted, so everything is pulled again.
+ */
+bool sync_from_pic32() {
+    if (selected_token_index < 0) {
+        return false;
+    }
+    
+    for (uint8_t attempt = 0; attempt < 2; attempt++) {
+        uint8_t request[4];
+        request[0] = pic_generation & 0xFF;
+        request[1] = (pic_generation >> 8) & 0xFF;
+        request[2] = (pic_generation >> 16) & 0xFF;
+        request[3] = (pic_generation >> 24) & 0xFF;
+        
+        // Reply: status, length, epoch, generation, page mask, changed pages
+        uint8_t response[SPI_BUFFER_SIZE];
+        uint8_t response_len = 0;
+        if (!send_to_pic32(PIC_CMD_SAVE_TOKEN_DELTA, request, 4, response, &response_len) ||
+            response_len < 11) {
+            return false;
+        }
+        
+        uint32_t epoch = ((uint32_t)response[2]) |
+                         ((uint32_t)response[3] << 8) |
+                         ((uint32_t)response[4] << 16) |
+                         ((uint32_t)response[5] << 24);
+        uint32_t generation = ((uint32_t)response[6]) |
+                              ((uint32_t)response[7] << 8) |
+                              ((uint32_t)response[8] << 16) |
+                              ((uint32_t)response[9] << 24);
+        uint8_t mask = response[10];
+        uint8_t pos = 11;
+        
+        // The length byte must cover exactly the pages the mask names,
+        // otherwise the two ends disagree on the frame layout
+        if (response[1] != 9 + 4 * __builtin_popcount(mask)) {
+            return false;
+        }
+        
+        if (pic_generation != 0 && epoch != pic_epoch) {
+            // PIC32 restarted: resync from scratch
+            pic_generation = 0;
+            continue;
+        }
+        
+        if (mask) {
+            sync_generation++;
+        }
+        for (uint8_t page = 0; page < NUM_PAGES; page++) {
+            if (!((mask >> page) & 1)) {
+                continue;
+            }
+            if (pos + 4 > response_len) {
+                return false;
+            }
+            uint32_t data = ((uint32_t)response[pos]) |
+                            ((uint32_t)response[pos + 1] << 8) |
+                            ((uint32_t)response[pos + 2] << 16) |
+                            ((uint32_t)response[pos + 3] << 24);
+            token_set_page(&tokens[selected_token_index], page, data);
+            page_generation[page] = sync_generation;
+            pos += 4;
+        }
+        
+        pic_epoch = epoch;
+        pic_generation = generation;
+        return true;
+    }
+    
+    return false;
+}
+
+/*
+ * Copy the whole selected token from the PIC32
+ * Pages that differ from the bridge copy are stamped with a new sync
+ * generation, so the Flipper's next delta still carries them.
+ */
+bool pull_token_from_pic32() {
+    if (selected_token_index < 0) {
+        return false;
+    }
+    
+    // Reply: status, length, token image (8 pages, little-endian)
+    uint8_t response[SPI_BUFFER_SIZE];
+    uint8_t response_len = 0;
+    if (!send_to_pic32(PIC_CMD_SAVE_TOKEN, NULL, 0, response, &response_len) ||
+        response[1] != TOKEN_SIZE || response_len < 2 + TOKEN_SIZE) {
+        return false;
+    }
+    
+    Token* token = &tokens[selected_token_index];
+    bool bumped = false;
+    for (uint8_t page = 0; page < NUM_PAGES; page++) {
+        const uint8_t* p = &response[2 + page * 4];
+        uint32_t data = ((uint32_t)p[0]) |
+                        ((uint32_t)p[1] << 8) |
+                        ((uint32_t)p[2] << 16) |
+                        ((uint32_t)p[3] << 24);
+        if (token_get_page(token, page) == data) {
+            continue;
+        }
+        if (!bumped) {
+            sync_generation++;
+            bumped = true;
+        }
+        token_set_page(token, page, data);
+        page_generation[page] = sync_generation;
+    }
+    
+    return true;
+}
+
 /*
  * Main loop
  */
@@ -338,6 +505,7 @@ void cmd_reset(const uint8_t* data, uint8_t len, uint8_t* response, uint8_t* res
     reset_pic32();
     emulation_active = false;
     selected_token_index = -1;
+    pic_generation = 0;
     response[0] = 0x00;
     *response_len = 1;
 }
@@ -388,8 +556,47 @@ void cmd_save_token(const uint8_t* data, uint8_t len, uint8_t* response, uint8_t
     }
     
     Token* token = &tokens[selected_token_index];
-    memcpy(response, token, TOKEN_SIZE);
-    *response_len = TOKEN_SIZE;
+    
+    // Keep the last copy if the PIC32 does not answer
+    if (len < 4) {
+        // No generation: the whole token, read in full from the PIC32
+        pull_token_from_pic32();
+        memcpy(response, token, TOKEN_SIZE);
+        *response_len = TOKEN_SIZE;
+        return;
+    }
+    
+    sync_from_pic32();
+    
+    // Bytes 0-3: generation the Flipper last saw. Reply: current
+    // generation, page mask, then the pages changed after it
+    uint32_t since = ((uint32_t)data[0]) |
+                     ((uint32_t)data[1] << 8) |
+                     ((uint32_t)data[2] << 16) |
+                     ((uint32_t)data[3] << 24);
+    if (since > sync_generation) {
+        since = 0;  // From before a bridge restart
+    }
+    
+    uint8_t mask = 0;
+    uint8_t pos = 5;
+    for (uint8_t page = 0; page < NUM_PAGES; page++) {
+        if (page_generation[page] > since || since == 0) {
+            uint32_t value = token_get_page(token, page);
+            mask |= 1 << page;
+            response[pos++] = value & 0xFF;
+            response[pos++] = (value >> 8) & 0xFF;
+            response[pos++] = (value >> 16) & 0xFF;
+            response[pos++] = (value >> 24) & 0xFF;
+        }
+    }
+    
+    response[0] = sync_generation & 0xFF;
+    response[1] = (sync_generation >> 8) & 0xFF;
+    response[2] = (sync_generation >> 16) & 0xFF;
+    response[3] = (sync_generation >> 24) & 0xFF;
+    response[4] = mask;
+    *response_len = pos;
 }
 
 void cmd_list_tokens(const uint8_t* data, uint8_t len, uint8_t* response, uint8_t* response_len) {
@@ -424,6 +631,7 @@ void cmd_select_token(const uint8_t* data, uint8_t len, uint8_t* response, uint8
     }
     
     selected_token_index = slot;
+    pic_generation = 0;  // Next sync pulls (and stamps) every page
     
     // Send token to PIC32
     if (send_to_pic32(CMD_LOAD_TOKEN, (uint8_t*)&tokens[slot], TOKEN_SIZE, response, response_len)) {
@@ -53,6 +53,7 @@
 #define PIC_CMD_RESET       0x02
 #define PIC_CMD_READ_PAGE   0x10
 #define PIC_CMD_WRITE_PAGE  0x20
+#define PIC_CMD_WRITE_PAGES 0x21
 #define PIC_CMD_SET_KEY     0x30
 #define PIC_CMD_GET_KEY     0x31
 #define PIC_CMD_SET_UID     0x40
@@ -61,9 +62,19 @@
 #define PIC_CMD_GET_CONFIG  0x51
 #define PIC_CMD_LOAD_TOKEN  0x60
 #define PIC_CMD_SAVE_TOKEN  0x61
+#define PIC_CMD_BANK_LOAD   0x62
+#define PIC_CMD_BANK_SELECT 0x63
+#define PIC_CMD_BANK_LIST   0x64
+#define PIC_CMD_STORE_SAVE  0x65
+#define PIC_CMD_STORE_DROP  0x66
+#define PIC_CMD_STORE_INFO  0x67
+#define PIC_CMD_SAVE_TOKEN_DELTA 0x68
+#define PIC_CMD_BANK_AUTH   0x69
 #define PIC_CMD_START_EMULATE 0x70
 #define PIC_CMD_STOP_EMULATE  0x71
 #define PIC_CMD_GET_STATUS    0x80
+#define PIC_CMD_GET_CRYPTO    0x81
+#define PIC_CMD_GET_PROFILE   0x82
 #define PIC_CMD_DEBUG_MODE    0xA0
 
 // Status codes
@@ -92,6 +103,10 @@ typedef struct {
 
 // Token management
 Token create_default_token();
+uint32_t token_get_page(const Token* token, uint8_t page);
+void token_set_page(Token* token, uint8_t page, uint32_t data);
+bool sync_from_pic32();
+bool pull_token_from_pic32();
 
 // Command callbacks
 typedef void (*CommandCallback)(const uint8_t* data, uint8_t len, uint8_t* response, uint8_t* response_len);
@@ -22,6 +22,10 @@
 #define MAX_TOKENS 10
 #define TOKEN_SIZE 32
 
+/* Ticks between token syncs while emulating */
+#define SYNC_TICK_PERIOD_MS 250
+#define SYNC_TICKS          4
+
 /* Token structure */
 typedef struct {
     uint32_t uid;           // Page 0: Serial number
@@ -46,6 +50,7 @@ struct App {
     Token token_list[MAX_TOKENS];
     int selected_token_index;
     bool emulation_active;
+    uint32_t sync_generation;   // Bridge generation app->token matches
     
     // Communication
     SerialConnection* serial;
@@ -65,6 +70,7 @@ void app_free(App* app);
 
 /* Event handlers */
 bool hitag2_app_custom_event_callback(void* context, uint32_t event);
+void hitag2_app_tick_event_callback(void* context);
 bool hitag2_app_handle_back(void* context);
 bool hitag2_app_handle_menu(void* context);
 
@@ -76,6 +82,7 @@ void hitag2_app_free_resources(App* app);
 bool hitag2_app_start_emulation(App* app);
 bool hitag2_app_stop_emulation(App* app);
 bool hitag2_app_load_token(App* app, Token* token);
+bool hitag2_app_sync_token(App* app);
 
 /* Accessors */
 Token* hitag2_app_get_token(App* app);
@@ -11,6 +11,15 @@
 /* Maximum buffer size */
 #define UART_BUFFER_SIZE 64
 
+/* Frame start byte */
+#define SOF 0x02
+
+/* Arduino bridge commands */
+#define CMD_LOAD_TOKEN      0x10
+#define CMD_SAVE_TOKEN      0x11
+#define CMD_START_EMULATE   0x40
+#define CMD_STOP_EMULATE    0x41
+
 /* Serial connection */
 typedef struct SerialConnection SerialConnection;
 
@@ -55,6 +55,8 @@ App* app_alloc(void) {
         app->view_dispatcher, ViewDispatcherTypeFullscreen, NULL);
     view_dispatcher_set_event_callback_context(app->view_dispatcher, app);
     view_dispatcher_set_custom_event_callback(app->view_dispatcher, hitag2_app_custom_event_callback);
+    view_dispatcher_set_tick_event_callback(
+        app->view_dispatcher, hitag2_app_tick_event_callback, SYNC_TICK_PERIOD_MS);
     
     // Allocate views
     app->view_main = hitag2_view_main_alloc(app);
@@ -66,6 +68,7 @@ App* app_alloc(void) {
     app->connected = false;
     app->selected_token_index = -1;
     app->emulation_active = false;
+    app->sync_generation = 0;
     app->tick_counter = 0;
     
     // Initialize token
@@ -108,6 +111,21 @@ bool hitag2_app_custom_event_callback(void* context, uint32_t event) {
     return false;
 }
 
+/* Tick callback: pick up reader writes while emulating */
+void hitag2_app_tick_event_callback(void* context) {
+    App* app = context;
+    
+    if (!app->connected || !app->emulation_active) {
+        app->tick_counter = 0;
+        return;
+    }
+    
+    if (++app->tick_counter >= SYNC_TICKS) {
+        app->tick_counter = 0;
+        hitag2_app_sync_token(app);
+    }
+}
+
 /* Back button handler */
 bool hitag2_app_handle_back(void* context) {
     App* app = context;
@@ -200,6 +218,7 @@ bool hitag2_app_load_token(App* app, Token* token) {
     
     if (serial_send_command(app->serial, CMD_LOAD_TOKEN, (uint8_t*)token, sizeof(Token), response, &response_len)) {
         app->token = *token;
+        app->sync_generation = 0;
         hitag2_app_update_status(app);
         return true;
     }
@@ -207,6 +226,86 @@ bool hitag2_app_load_token(App* app, Token* token) {
     return false;
 }
 
+/* Write one page of the emulator's memory into the token */
+static void hitag2_app_token_set_page(Token* token, uint8_t page, uint32_t data) {
+    switch (page) {
+        case 0:
+            token->uid = data;
+            break;
+        case 1:
+            token->config = data;
+            break;
+        case 2:
+            token->key[0] = data & 0xFF;
+            token->key[1] = (data >> 8) & 0xFF;
+            token->key[2] = (data >> 16) & 0xFF;
+            token->key[3] = (data >> 24) & 0xFF;
+            break;
+        case 3:
+            // Lower half is the password, not kept in Token
+            token->key[4] = (data >> 16) & 0xFF;
+            token->key[5] = (data >> 24) & 0xFF;
+            break;
+        default:
+            token->user_data[page - 4] = data;
+            break;
+    }
+}
+
+/* Pull the pages changed since the last sync from the bridge */
+bool hitag2_app_sync_token(App* app) {
+    if (!app->connected) {
+        return false;
+    }
+    
+    // Request: generation we hold. Reply: current generation, page mask,
+    // then each changed page (4 bytes, little-endian, in page order)
+    uint8_t request[4];
+    request[0] = app->sync_generation & 0xFF;
+    request[1] = (app->sync_generation >> 8) & 0xFF;
+    request[2] = (app->sync_generation >> 16) & 0xFF;
+    request[3] = (app->sync_generation >> 24) & 0xFF;
+    
+    uint8_t response[UART_BUFFER_SIZE];
+    uint8_t response_len = sizeof(response);
+    
+    if (!serial_send_command(app->serial, CMD_SAVE_TOKEN, request, sizeof(request), response, &response_len) ||
+        response_len < 5) {
+        return false;
+    }
+    
+    uint32_t generation = ((uint32_t)response[0]) |
+                          ((uint32_t)response[1] << 8) |
+                          ((uint32_t)response[2] << 16) |
+                          ((uint32_t)response[3] << 24);
+    uint8_t mask = response[4];
+    uint8_t pos = 5;
+    
+    for (uint8_t page = 0; page < 8; page++) {
+        if (!((mask >> page) & 1)) {
+            continue;
+        }
+        if (pos + 4 > response_len) {
+            return false;
+        }
+        uint32_t data = ((uint32_t)response[pos]) |
+                        ((uint32_t)response[pos + 1] << 8) |
+                        ((uint32_t)response[pos + 2] << 16) |
+                        ((uint32_t)response[pos + 3] << 24);
+        hitag2_app_token_set_page(&app->token, page, data);
+        pos += 4;
+    }
+    
+    app->sync_generation = generation;
+    if (mask) {
+        if (app->selected_token_index >= 0 && app->selected_token_index < MAX_TOKENS) {
+            app->token_list[app->selected_token_index] = app->token;
+        }
+        hitag2_app_update_status(app);
+    }
+    return true;
+}
+
 /* Get current token */
 Token* hitag2_app_get_token(App* app) {
     return &app->token;
@@ -113,6 +113,9 @@ static void hitag2_view_main_enter(void* context) {
     Hitag2ViewMain* instance = context;
     App* app = instance->app;
     
+    // Pick up changes made while another view was open
+    hitag2_app_sync_token(app);
+    
     // Update status
     hitag2_app_update_status(app);
 }
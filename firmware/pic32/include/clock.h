@@ -0,0 +1,19 @@
+/*
+ * Hi-Tag 2 Emulator - System Clock Header
+ * One definition of the system clock for every module that derives a
+ * rate or a delay from it (CP0 Count, PWM, busy-wait loops)
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+// SYSCLK set up by system_init() (override with -D when running at
+// another clock setting)
+#ifndef SYSCLK_HZ
+#define SYSCLK_HZ  80000000UL
+#endif
+
+// CP0 Count runs at SYSCLK/2
+#define SYSCLK_COUNT_PER_US  (SYSCLK_HZ / 2 / 1000000UL)
+
+#endif // CLOCK_H
@@ -8,11 +8,107 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+// Tuples per bitsliced batch pass (one lane per bit of a native word)
+#if defined(__PIC32MX__)
+#define CRYPTO_BATCH_LANES  32
+#else
+#define CRYPTO_BATCH_LANES  64
+#endif
+
+// One bit per lane of a bitsliced pass
+#if CRYPTO_BATCH_LANES == 64
+typedef uint64_t crypto_lanes_t;
+#else
+typedef uint32_t crypto_lanes_t;
+#endif
+
+// Batch kernels, narrowest to widest
+// SIMD kernels are only available in x86 host builds
+typedef enum {
+    CRYPTO_KERNEL_SCALAR = 0,   // crypto_compute_response() per tuple
+    CRYPTO_KERNEL_BITSLICE,     // Native word bitsliced
+    CRYPTO_KERNEL_SSE42,        // 128-bit vectors
+    CRYPTO_KERNEL_AVX2,         // 256-bit vectors
+    CRYPTO_KERNEL_AVX512,       // 512-bit vectors
+    CRYPTO_KERNEL_COUNT
+} crypto_kernel_t;
+
 // 48-bit key type
 typedef struct {
     uint8_t bytes[6];
 } hitag2_key_t;
 
+// Per-token key schedule (see crypto_ctx_init)
+// Everything in the auth path that depends only on key and UID
+typedef struct {
+    uint64_t state;             // Initial state: UID | Key[15:0] << 32
+    uint32_t key_high;          // Key[47:16], XORed with the challenge
+    uint8_t filter_index[32];   // Key/UID-only fc index bits per init round
+} crypto_ctx_t;
+
+// Keys answered per challenge by crypto_multi_response (one pass)
+#define CRYPTO_MULTI_MAX  CRYPTO_BATCH_LANES
+
+// Token bank prepared for crypto_multi_response
+// Key/UID bits already transposed into bit planes, one lane per token
+typedef struct {
+    uint8_t count;                  // Tokens in the bank
+    crypto_lanes_t state[48];       // UID | Key[15:0] << 32, per bit
+    crypto_lanes_t key_high[32];    // Key[47:16], per bit
+} crypto_multi_t;
+
+// Keystream lookahead (bits buffered by crypto_stream_fill)
+#define CRYPTO_STREAM_LOOKAHEAD  64
+
+// Keystream iterator for an authenticated session
+// Holds the LFSR state and a buffer of precomputed keystream bits
+typedef struct {
+    uint64_t state;     // LFSR state after the last buffered bit
+    uint64_t buffer;    // Buffered keystream, next bit in bit 0
+    uint8_t count;      // Valid bits in buffer
+} crypto_stream_t;
+
+// Cipher initialization in progress (see crypto_begin)
+// Challenge bits are folded in one at a time as they are received
+typedef struct {
+    uint64_t state;             // LFSR state after the bits fed so far
+    uint32_t challenge;         // Bits fed so far, first in bit 0
+    uint8_t count;              // Bits fed (32 = ready for crypto_finish)
+    const crypto_ctx_t* ctx;    // Key schedule in use
+    crypto_ctx_t own;           // Schedule built by crypto_begin()
+} crypto_feed_t;
+
+// Backend capability flags
+#define CRYPTO_CAP_HITAG2     0x01  // Implements the Hi-Tag 2 cipher
+#define CRYPTO_CAP_REFERENCE  0x02  // Bit-serial reference (checked against a known answer)
+#define CRYPTO_CAP_TABLES     0x04  // Uses generated lookup tables
+#define CRYPTO_CAP_BITSLICE   0x08  // Bitsliced kernel
+#define CRYPTO_CAP_BATCH      0x10  // Provides a batch entry point
+#define CRYPTO_CAP_CONSTTIME  0x20  // Branch-free, table-free, fixed cost
+#define CRYPTO_CAP_LEGACY     0x80  // Simplified LFSR, never auto-selected
+
+// Response function signature shared by all backends
+typedef uint32_t (*crypto_response_fn_t)(const uint8_t* key, uint32_t uid, uint32_t challenge);
+
+// Batch function signature (see crypto_compute_response_batch)
+typedef void (*crypto_batch_fn_t)(const hitag2_key_t* keys, const uint32_t* uids,
+                                  const uint32_t* challenges, uint32_t* responses,
+                                  uint32_t count);
+
+// Crypto backend descriptor
+typedef struct {
+    const char* name;
+    uint8_t caps;                   // CRYPTO_CAP_* flags
+    crypto_response_fn_t compute;   // Single response
+    crypto_batch_fn_t batch;        // Batch entry point (NULL if none)
+} crypto_backend_t;
+
+// Benchmark result of one backend
+typedef struct {
+    bool correct;                   // Matched the reference vectors
+    uint32_t ticks;                 // Timer ticks per response (0 if not run)
+} crypto_backend_stats_t;
+
 // Initialize crypto subsystem
 void crypto_init(void);
 
@@ -27,10 +123,150 @@ void crypto_get_key(uint8_t* key);
 // returns: 32-bit encrypted response
 uint32_t crypto_compute_response(const uint8_t* key, uint32_t uid, uint32_t challenge);
 
+// Compute responses for many tuples with the bitsliced kernel
+// keys/uids/challenges: count input tuples
+// responses: count outputs, identical to crypto_compute_response()
+void crypto_compute_response_batch(const hitag2_key_t* keys, const uint32_t* uids,
+                                   const uint32_t* challenges, uint32_t* responses,
+                                   uint32_t count);
+
+// Answer one challenge for every token of a bank in a single pass
+// crypto_multi_init: count (<= CRYPTO_MULTI_MAX) keys and UIDs, once per bank
+// crypto_multi_response: count outputs, identical to crypto_compute_response()
+bool crypto_multi_init(crypto_multi_t* multi, const hitag2_key_t* keys,
+                       const uint32_t* uids, uint32_t count);
+void crypto_multi_response(const crypto_multi_t* multi, uint32_t challenge,
+                           uint32_t* responses);
+
+// Batch kernel selection (widest supported kernel is used by default)
+bool crypto_batch_kernel_supported(crypto_kernel_t kernel);
+bool crypto_batch_set_kernel(crypto_kernel_t kernel);
+crypto_kernel_t crypto_batch_get_kernel(void);
+const char* crypto_batch_kernel_name(crypto_kernel_t kernel);
+
+// Backend registry
+// The first crypto_init() benchmarks every backend and pins the fastest
+// correct one (only the consttime backend when built with
+// -DCRYPTO_CONSTANT_TIME); crypto_backend_calibrate() re-runs it
+uint8_t crypto_backend_count(void);
+const crypto_backend_t* crypto_backend_get(uint8_t index);
+const crypto_backend_stats_t* crypto_backend_stats(uint8_t index);
+uint8_t crypto_backend_active(void);
+bool crypto_backend_select(uint8_t index);
+uint8_t crypto_backend_calibrate(void);
+
+// Timer ticks per microsecond used by the backend benchmark and profile
+// (PIC32: CP0 Count at SYSCLK/2; host: nanoseconds)
+uint32_t crypto_ticks_per_us(void);
+
+// Cycle profile of live crypto calls (on by default on the PIC32; host
+// builds opt in with -DCRYPTO_PROFILE, updates are not thread-safe)
+#if defined(__PIC32MX__) && !defined(CRYPTO_NO_PROFILE) && !defined(CRYPTO_PROFILE)
+#define CRYPTO_PROFILE
+#endif
+
+// Profile slots after the per-backend ones (crypto_compute_response)
+typedef enum {
+    CRYPTO_PROFILE_CTX = 0,     // crypto_compute_response_ctx
+    CRYPTO_PROFILE_AUTH,        // crypto_stream_auth_ctx (whole challenge)
+    CRYPTO_PROFILE_FINISH,      // crypto_finish (the RF reply path)
+    CRYPTO_PROFILE_PATHS
+} crypto_profile_path_t;
+
+// Timer ticks per call of one profile slot
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;             // Mean = total / count
+} crypto_profile_t;
+
+// Slots 0 .. crypto_backend_count()-1 are the backends, then the paths
+uint8_t crypto_profile_count(void);
+uint8_t crypto_profile_slot(crypto_profile_path_t path);
+const char* crypto_profile_name(uint8_t slot);
+bool crypto_profile_get(uint8_t slot, crypto_profile_t* profile);
+void crypto_profile_reset(void);
+
+// Backend implementations (normally reached through crypto_compute_response)
+uint32_t crypto_response_bitserial(const uint8_t* key, uint32_t uid, uint32_t challenge);
+uint32_t crypto_response_table(const uint8_t* key, uint32_t uid, uint32_t challenge);
+uint32_t crypto_response_bitslice(const uint8_t* key, uint32_t uid, uint32_t challenge);
+uint32_t crypto_response_consttime(const uint8_t* key, uint32_t uid, uint32_t challenge);
+
+// Precomputed key schedule: build once per key/UID, then each
+// authentication only folds in the challenge
+void crypto_ctx_init(crypto_ctx_t* ctx, const uint8_t* key, uint32_t uid);
+uint32_t crypto_compute_response_ctx(const crypto_ctx_t* ctx, uint32_t challenge);
+void crypto_stream_init_ctx(crypto_stream_t* stream, const crypto_ctx_t* ctx,
+                            uint32_t challenge);
+
+// Incremental initialization, pipelined with challenge reception
+// crypto_begin/crypto_begin_ctx: load the state (no challenge bits yet)
+// crypto_feed_bit: fold in the next challenge bit as the RF decoder
+//   delivers it (bit 0 of the challenge first); false once all 32 are in
+// crypto_finish: generate the response and start the session keystream;
+//   same result as crypto_stream_auth_ctx() on the whole challenge
+void crypto_begin(crypto_feed_t* feed, const uint8_t* key, uint32_t uid);
+void crypto_begin_ctx(crypto_feed_t* feed, const crypto_ctx_t* ctx);
+bool crypto_feed_bit(crypto_feed_t* feed, uint8_t bit);
+uint32_t crypto_finish(crypto_feed_t* feed, crypto_stream_t* stream);
+
+// Response cache entries (hashed by UID and challenge, LRU per set)
+#define CRYPTO_CACHE_ENTRIES  64
+
+// Authenticate through the response cache and start the session
+// keystream after the response; returns the response. Cached entries
+// belong to the current key: crypto_set_key() and memory_set_key()
+// invalidate them. Constant-time builds bypass the cache.
+uint32_t crypto_stream_auth_ctx(crypto_stream_t* stream, const crypto_ctx_t* ctx,
+                                uint32_t challenge);
+void crypto_cache_invalidate(void);
+void crypto_cache_stats(uint32_t* hits, uint32_t* misses);
+
+// Keystream iterator
+// crypto_stream_init: positions at keystream bit 0; the first word
+// is the authentication response, later bits encrypt session traffic
+void crypto_stream_init(crypto_stream_t* stream, const uint8_t* key,
+                        uint32_t uid, uint32_t challenge);
+void crypto_stream_fill(crypto_stream_t* stream);
+uint8_t crypto_stream_next_bit(crypto_stream_t* stream);
+uint8_t crypto_stream_next_byte(crypto_stream_t* stream);
+uint32_t crypto_stream_next_word32(crypto_stream_t* stream);
+
+// Advance the Hi-Tag 2 LFSR by n keystream steps (O(log n))
+uint64_t crypto_lfsr_jump(uint64_t state, uint64_t n);
+
+// Advance any 48-bit LFSR by n steps
+// taps: pre-shift tap mask (bit N set when State[N] feeds State[47])
+// Powers of the step matrix are cached per tap mask
+uint64_t crypto_lfsr_jump_taps(uint64_t state, uint64_t n, uint64_t taps);
+
 // Verify a response (for reader emulation)
 bool crypto_verify_response(const uint8_t* key, uint32_t uid, uint32_t challenge, uint32_t response);
 
+// Verify with early reject: keystream generation stops at the first
+// byte that differs from the response
+bool crypto_verify_response_table(const uint8_t* key, uint32_t uid, uint32_t challenge,
+                                  uint32_t response);
+bool crypto_verify_response_ctx(const crypto_ctx_t* ctx, uint32_t challenge, uint32_t response);
+
+// Verify many candidates, rejecting each as soon as a keystream bit
+// differs from its response
+// keys: one key shared by all candidates (num_keys == 1) or one key
+//       per candidate (num_keys == count)
+// valid: count results
+// returns: number of valid candidates
+uint32_t crypto_verify_response_batch(const hitag2_key_t* keys, uint32_t num_keys,
+                                      const uint32_t* uids, const uint32_t* challenges,
+                                      const uint32_t* responses, bool* valid,
+                                      uint32_t count);
+
 // Alternative implementation using byte-level operations
 uint32_t crypto_compute_response_v2(const uint8_t* key, uint32_t uid, uint32_t challenge);
 
+// Older simplified LFSRs (not the Hi-Tag 2 cipher, kept for comparison)
+uint32_t crypto_lfsr_shift(uint8_t* state, int num_bits);
+uint64_t crypto_lfsr_simple(uint64_t state, int count, uint64_t* output);
+
 #endif // CRYPTO_H
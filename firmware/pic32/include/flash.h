@@ -0,0 +1,56 @@
+/*
+ * Hi-Tag 2 Emulator - Flash Header
+ * Word program and page erase on the flash region kept for the token store
+ *
+ * The region is the top FLASH_STORE_SIZE bytes of program flash, taken
+ * out of kseg0_program_mem in linker_script.ld. Offsets below are from
+ * the start of the region. Flash is NOR: erase sets a page to all ones,
+ * programming only clears bits, and a word is programmed at most once
+ * between erases.
+ *
+ * The host build (tools/flash_file.c) backs the same calls with a file,
+ * so the token store runs and is benchmarked on a workstation.
+ */
+
+#ifndef FLASH_H
+#define FLASH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Erase unit of the PIC32MX795 program flash
+#define FLASH_PAGE_SIZE   4096
+
+// Value of an erased word
+#define FLASH_ERASED      0xFFFFFFFFUL
+
+// Token store region: last 64 KB of the 512 KB program flash
+// (physical address; must match linker_script.ld)
+#define FLASH_STORE_BASE  0x1D070000UL
+#define FLASH_STORE_SIZE  (64UL * 1024)
+
+// Size of the region in bytes (a multiple of FLASH_PAGE_SIZE)
+uint32_t flash_size(void);
+
+// Read a word (offset is word aligned)
+uint32_t flash_read_word(uint32_t offset);
+
+// Program an erased word
+// returns: false on a programming error
+bool flash_write_word(uint32_t offset, uint32_t word);
+
+// Erase the page holding offset
+// returns: false on an erase error
+bool flash_erase_page(uint32_t offset);
+
+#ifndef __PIC32MX__
+// Host backing file, created erased if missing or short
+bool flash_file_open(const char* path, uint32_t size);
+void flash_file_close(void);
+
+// Power-cut simulation: the next words programs succeed, every program
+// and erase after that fails until flash_file_close()
+void flash_file_fail_after(uint32_t words);
+#endif
+
+#endif // FLASH_H
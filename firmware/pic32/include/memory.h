@@ -13,11 +13,27 @@
 #define PAGE_SIZE     32  // bits per page
 #define TOTAL_BITS    256 // 8 pages × 32 bits
 
-// Memory page structure
+// RAM given to the token bank (the PIC32MX795 has 128 KB); the number
+// of slots is this divided by the size of one slot (pages and key
+// schedule)
+#ifndef MEMORY_BANK_BYTES
+#define MEMORY_BANK_BYTES  (32UL * 1024)
+#endif
+
+// Page store of one token: the pages as one packed word array and a
+// bit per page in writable, so the pages take 36 bytes instead of 64 and
+// are copied or encoded with plain word loops. The key schedule next to
+// them in each bank slot is larger (48 bytes), so a whole slot only
+// shrinks from 120 to 88 bytes. The config lock bit stays in page 1
+// (memory_is_locked()) and is not part of writable.
 typedef struct {
-    uint32_t data;
-    bool writable;
-} page_t;
+    uint32_t data[NUM_PAGES];
+    uint8_t writable;           // Bit n set: page n accepts writes
+} page_store_t;
+
+#if NUM_PAGES > 8
+#error "page_store_t.writable holds one bit per page"
+#endif
 
 // Initialize memory subsystem
 void memory_init(void);
@@ -26,10 +42,52 @@ void memory_init(void);
 void memory_load_token(const uint8_t* buffer, uint16_t len);
 void memory_save_token(uint8_t* buffer, uint16_t* len);
 
+// Token bank: images held in RAM, one of them active
+// Selecting a loaded slot switches identity without an SPI upload
+uint16_t memory_bank_slots(void);
+uint16_t memory_bank_active(void);
+bool memory_bank_load(uint16_t slot, const uint8_t* buffer, uint16_t len);
+bool memory_bank_select(uint16_t slot);
+bool memory_bank_used(uint16_t slot);
+uint32_t memory_bank_uid(uint16_t slot);
+bool memory_bank_image(uint16_t slot, uint8_t* buffer);
+
+// Responses of count slots to one challenge, CRYPTO_MULTI_MAX per pass
+uint16_t memory_bank_auth(uint16_t first, uint16_t count, uint32_t challenge,
+                          uint32_t* responses);
+
+// Persistence: bank slots saved in the flash token store come back at boot
+uint16_t memory_bank_restore(void);
+
 // Page access
 uint32_t memory_read_page(uint8_t page);
 bool memory_write_page(uint8_t page, uint32_t data);
 
+// Page transaction: several pages become visible in one step
+void memory_txn_begin(void);
+bool memory_txn_write(uint8_t page, uint32_t data);
+bool memory_txn_commit(void);
+void memory_txn_abort(void);
+
+// Change tracking: every change bumps the generation; a sync asks for
+// the pages changed since the generation it last saw. Generations are
+// only comparable within one boot epoch.
+uint32_t memory_epoch_advance(void);
+uint32_t memory_epoch(void);
+uint32_t memory_generation(void);
+uint8_t memory_changed_since(uint32_t generation);
+
+// Crypto-mode session (after START_AUTH)
+// Pages are encrypted/decrypted with the session keystream; the
+// challenge is folded in bit by bit as RX decodes it
+void memory_auth_begin(void);
+bool memory_auth_feed_bit(uint8_t bit);
+uint32_t memory_auth_finish(void);
+void memory_auth_stop(void);
+bool memory_auth_active(void);
+uint32_t memory_read_page_crypto(uint8_t page);
+bool memory_write_page_crypto(uint8_t page, uint32_t data);
+
 // UID access
 uint32_t memory_get_uid(void);
 void memory_set_uid(uint32_t uid);
@@ -39,9 +39,15 @@ void rf_carrier_off(void);
 void rf_send_manchester(const uint8_t* data, uint16_t num_bits);
 void rf_send_bpsk(const uint8_t* data, uint16_t num_bits);
 
+// Called with each bit as soon as it is decoded (index: position in
+// the frame); must return within a few µs
+typedef void (*rf_bit_handler_t)(uint8_t bit, uint16_t index);
+
 // Demodulation
 uint16_t rf_receive_manchester(uint8_t* buffer, uint16_t max_bits, uint32_t timeout_ms);
 uint16_t rf_receive_simple(uint8_t* buffer, uint16_t max_bits, uint32_t timeout_ms);
+uint16_t rf_receive_bits(uint8_t* buffer, uint16_t max_bits, uint32_t timeout_ms,
+                         rf_bit_handler_t on_bit);
 
 // Field detection
 bool rf_wait_for_field(uint32_t timeout_ms);
@@ -64,5 +70,6 @@ void pwm_set_duty(uint16_t duty);
 // Timing helpers
 void rf_send_start_gap(uint16_t gap_us);
 void rf_send_response_delay(uint16_t delay_us);
+uint16_t rf_get_response_delay_us(void);
 
 #endif // RF_DRIVER_H
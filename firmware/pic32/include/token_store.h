@@ -0,0 +1,63 @@
+/*
+ * Hi-Tag 2 Emulator - Token Store Header
+ * Persistent token images in flash: an append-only log with a RAM index
+ *
+ * Records are keyed by a 16-bit number (the bank slot they restore into)
+ * and hold one 32-byte token image. Every put or delete appends a record;
+ * the newest record of a key wins. The log runs round the flash region
+ * page by page, and when only the reserve is left free the oldest page
+ * is compacted (its live records are copied to the head and it is
+ * erased), so every page is erased in turn and wear is level.
+ *
+ * Nothing but the index lives in RAM. token_store_init() rebuilds it at
+ * boot in one sequential pass over the region; records cut short by a
+ * power loss fail their CRC and are skipped.
+ */
+
+#ifndef TOKEN_STORE_H
+#define TOKEN_STORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Bytes of token image per record (8 pages × 32 bits)
+#define TOKEN_STORE_IMAGE_SIZE  32
+
+// Keys 0..TOKEN_STORE_KEYS-1 (4 bytes of index RAM each)
+#ifndef TOKEN_STORE_KEYS
+#define TOKEN_STORE_KEYS        512
+#endif
+
+// Largest region the store uses, in flash pages
+#ifndef TOKEN_STORE_MAX_PAGES
+#define TOKEN_STORE_MAX_PAGES   64
+#endif
+
+// Counters since token_store_init() (erase counts are lifetime)
+typedef struct {
+    uint16_t keys;          // Keys holding a token
+    uint8_t pages;          // Pages in the region
+    uint8_t free_pages;     // Erased pages ahead of the log head
+    uint32_t puts;          // Records appended by put/delete
+    uint32_t copies;        // Records moved by compaction
+    uint32_t compactions;   // Pages compacted
+    uint32_t bytes_written; // Flash bytes programmed (records and headers)
+    uint32_t min_erase;     // Lowest page erase count
+    uint32_t max_erase;     // Highest page erase count
+} token_store_stats_t;
+
+// Scan the region and build the index (erases pages left half written)
+bool token_store_init(void);
+
+// Erase the whole region
+bool token_store_format(void);
+
+// Token image access (TOKEN_STORE_IMAGE_SIZE bytes)
+bool token_store_put(uint16_t key, const uint8_t* image);
+bool token_store_get(uint16_t key, uint8_t* image);
+bool token_store_delete(uint16_t key);
+bool token_store_has(uint16_t key);
+
+void token_store_stats(token_store_stats_t* stats);
+
+#endif // TOKEN_STORE_H
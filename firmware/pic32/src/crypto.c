@@ -2,46 +2,653 @@
  * Hi-Tag 2 Emulator - 48-bit Stream Cipher Module
  * Implements the Hi-Tag 2 challenge-response authentication
  * 
- * The cipher uses a 48-bit LFSR with the following polynomial:
- * P(x) = x^48 + x^44 + x^41 + x^40 + x^39 + x^37 + x^35 + x^34 + 
- *        x^31 + x^19 + x^14 + x^12 + x^4 + 1
+ * The cipher is a 48-bit LFSR with a non-linear output filter, as
+ * published by Verdult, Garcia and Balasch ("Gone in 360 seconds", 2012):
  * 
- * Simplified version using standard taps for emulation
+ * LFSR feedback (new State[47], taken before the shift):
+ *   S0 ^ S2 ^ S3 ^ S6 ^ S7 ^ S8 ^ S16 ^ S22 ^ S23 ^ S26 ^ S30 ^
+ *   S41 ^ S42 ^ S43 ^ S46 ^ S47
+ * 
+ * Output filter f20 over 20 state bits:
+ *   fa(S1,S2,S4,S5)  fb(S7,S11,S13,S14)  fb(S16,S20,S22,S25)
+ *   fb(S27,S28,S30,S32)  fa(S33,S42,S43,S45)  ->  fc(5 bits)
+ * 
+ * crypto_lfsr_shift/crypto_compute_response_v2 and crypto_lfsr_simple
+ * are older simplified LFSRs kept for comparison; they do not
+ * implement this cipher.
  */
 
 #include "crypto.h"
+#include "crypto_tables.h"
+#include "crypto_lfsr.h"
+#include "clock.h"
 #include "debug.h"
 
+#ifdef __PIC32MX__
+#include <xc.h>
+#else
+#include <time.h>
+#endif
+
 // Current secret key (48 bits)
 static uint8_t g_secret_key[6] = {0};
 
-// LFSR taps for Hi-Tag 2 (from reverse engineering)
-// These are the standard taps for the Philips/Siemens Hi-Tag 2 cipher
-#define LFSR_TAP_47    (1U << 47)  // Bit 47 (MSB)
-#define LFSR_TAP_45    (1U << 45)  // Bit 45
-#define LFSR_TAP_44    (1U << 44)  // Bit 44
-#define LFSR_TAP_43    (1U << 43)  // Bit 43
-#define LFSR_TAP_41    (1U << 41)  // Bit 41
-#define LFSR_TAP_39    (1U << 39)  // Bit 39
-#define LFSR_TAP_38    (1U << 38)  // Bit 38
-#define LFSR_TAP_35    (1U << 35)  // Bit 35
-#define LFSR_TAP_33    (1U << 33)  // Bit 33
-#define LFSR_TAP_32    (1U << 32)  // Bit 32
-#define LFSR_TAP_29    (1U << 29)  // Bit 29
-#define LFSR_TAP_23    (1U << 23)  // Bit 23
-#define LFSR_TAP_18    (1U << 18)  // Bit 18
-#define LFSR_TAP_16    (1U << 16)  // Bit 16
-#define LFSR_TAP_8     (1U << 8)   // Bit 8
-#define LFSR_TAP_0     (1U << 0)   // Bit 0 (LSB)
-
-// Alternative simplified taps (based on various sources)
-// The actual taps may vary depending on tag manufacturer
-#define LFSR_POLY      0x1B9E7F1A5C6D  // Example polynomial mask
+// Response cache: 16 sets x 4 ways, LRU within a set
+#define CRYPTO_CACHE_WAYS   4
+#define CRYPTO_CACHE_SETS   (CRYPTO_CACHE_ENTRIES / CRYPTO_CACHE_WAYS)
+#define CRYPTO_CACHE_SHIFT  28  // 32 - log2(CRYPTO_CACHE_SETS)
+
+typedef struct {
+    uint64_t state;         // LFSR state after the response bits
+    uint32_t uid;
+    uint32_t challenge;
+    uint32_t response;
+    uint8_t age;            // 0 = most recently used
+    bool valid;
+} crypto_cache_entry_t;
+
+static crypto_cache_entry_t g_crypto_cache[CRYPTO_CACHE_SETS][CRYPTO_CACHE_WAYS];
+static uint32_t g_crypto_cache_hits = 0;
+static uint32_t g_crypto_cache_misses = 0;
+
+// Hi-Tag 2 filter functions as packed lookup tables
+// Bit N of each constant is the output for input index N
+#define HITAG2_FA  0x2C79U       // 4-input, 16 entries
+#define HITAG2_FB  0x6671U       // 4-input, 16 entries
+#define HITAG2_FC  0x7907287BUL  // 5-input, 32 entries
+
+/*
+ * Feedback bits produced by 8 steps of a 48-bit linear LFSR
+ * table: per-byte feedback table generated by tools/gen_crypto_tables.c
+ * returns: feedback byte, destined for State[47:40]
+ */
+static inline uint64_t lfsr_feedback8(uint64_t state, const uint8_t table[6][256]) {
+    return table[0][(state >> 0) & 0xFF] ^
+           table[1][(state >> 8) & 0xFF] ^
+           table[2][(state >> 16) & 0xFF] ^
+           table[3][(state >> 24) & 0xFF] ^
+           table[4][(state >> 32) & 0xFF] ^
+           table[5][(state >> 40) & 0xFF];
+}
+
+/*
+ * Pack a 6-byte key (LSB first) into a 48-bit value
+ */
+static inline uint64_t key_pack(const uint8_t* key) {
+    return ((uint64_t)key[0] << 0) |
+           ((uint64_t)key[1] << 8) |
+           ((uint64_t)key[2] << 16) |
+           ((uint64_t)key[3] << 24) |
+           ((uint64_t)key[4] << 32) |
+           ((uint64_t)key[5] << 40);
+}
+
+// First-layer filter groups (bit N of the fc index)
+#define HITAG2_GROUP_A  0x01    // fa(S1, S2, S4, S5)
+#define HITAG2_GROUP_B  0x02    // fb(S7, S11, S13, S14)
+#define HITAG2_GROUP_C  0x04    // fb(S16, S20, S22, S25)
+#define HITAG2_GROUP_D  0x08    // fb(S27, S28, S30, S32)
+#define HITAG2_GROUP_E  0x10    // fa(S33, S42, S43, S45)
+#define HITAG2_GROUPS   0x1F
+
+// Init round i reads initial state bit i + 1 + (highest tap of a group).
+// While that is at most 47 the group depends only on key and UID:
+// A (S5) and B (S14) for all 32 rounds, and C, D, E for the first
+#define HITAG2_KNOWN_C_ROUNDS  22  // S25
+#define HITAG2_KNOWN_D_ROUNDS  15  // S32
+#define HITAG2_KNOWN_E_ROUNDS  2   // S45
+
+/*
+ * First layer of the Hi-Tag 2 filter for the selected groups
+ * 
+ * Each first-layer function reads a nibble gathered from the state
+ * with shifts and masks and indexes a 16-entry packed table. Works on
+ * 32-bit halves so the PIC32 avoids 64-bit shifts. With a constant
+ * group mask the unused gathers fold away. No branches.
+ * returns: partial fc index (bits of unselected groups are 0)
+ */
+static inline uint32_t hitag2_filter_index(uint64_t state, uint32_t groups) {
+    uint32_t lo = (uint32_t)state;
+    uint32_t hi = (uint32_t)(state >> 32);
+    uint32_t index = 0;
+    
+    if (groups & HITAG2_GROUP_A) {
+        uint32_t a = ((lo >> 1) & 0x3) | ((lo >> 2) & 0xC);
+        index |= (HITAG2_FA >> a) & 1;
+    }
+    if (groups & HITAG2_GROUP_B) {
+        uint32_t b = ((lo >> 7) & 0x1) | ((lo >> 10) & 0x2) | ((lo >> 11) & 0xC);
+        index |= ((HITAG2_FB >> b) & 1) << 1;
+    }
+    if (groups & HITAG2_GROUP_C) {
+        uint32_t c = ((lo >> 16) & 0x1) | ((lo >> 19) & 0x2) |
+                     ((lo >> 20) & 0x4) | ((lo >> 22) & 0x8);
+        index |= ((HITAG2_FB >> c) & 1) << 2;
+    }
+    if (groups & HITAG2_GROUP_D) {
+        uint32_t d = ((lo >> 27) & 0x3) | ((lo >> 28) & 0x4) | ((hi << 3) & 0x8);
+        index |= ((HITAG2_FB >> d) & 1) << 3;
+    }
+    if (groups & HITAG2_GROUP_E) {
+        uint32_t e = ((hi >> 1) & 0x1) | ((hi >> 9) & 0x6) | ((hi >> 10) & 0x8);
+        index |= ((HITAG2_FA >> e) & 1) << 4;
+    }
+    
+    return index;
+}
+
+/*
+ * Hi-Tag 2 output filter f20
+ * The five first-layer results index the 32-entry table of fc.
+ */
+static inline uint32_t hitag2_filter(uint64_t state) {
+    return (HITAG2_FC >> hitag2_filter_index(state, HITAG2_GROUPS)) & 1;
+}
+
+/*
+ * Hi-Tag 2 initialization: load UID and Key[15:0], then fold in
+ * Challenge XOR Key[47:16] through the filter, one bit per shift
+ * returns: LFSR state at the start of the keystream
+ */
+static inline uint64_t hitag2_init_state(uint64_t key_value, uint32_t uid, uint32_t challenge) {
+    uint64_t state = ((key_value & 0xFFFF) << 32) | uid;
+    uint32_t init = challenge ^ (uint32_t)(key_value >> 16);
+    
+    for (int i = 0; i < 32; i++) {
+        state >>= 1;
+        state |= (uint64_t)(hitag2_filter(state) ^ ((init >> i) & 1)) << 47;
+    }
+    
+    return state;
+}
+
+/*
+ * One init round with a precomputed key schedule
+ * groups: first-layer groups not covered by ctx->filter_index[i]
+ */
+static inline uint64_t hitag2_ctx_round(uint64_t state, const crypto_ctx_t* ctx,
+                                        uint32_t init, int i, uint32_t groups) {
+    state >>= 1;
+    uint32_t index = ctx->filter_index[i] | hitag2_filter_index(state, groups);
+    return state | ((uint64_t)(((HITAG2_FC >> index) & 1) ^ ((init >> i) & 1)) << 47);
+}
+
+/*
+ * Hi-Tag 2 initialization from a precomputed key schedule
+ * Only the groups that read challenge-dependent bits are evaluated.
+ */
+static inline uint64_t hitag2_init_state_ctx(const crypto_ctx_t* ctx, uint32_t challenge) {
+    uint64_t state = ctx->state;
+    uint32_t init = challenge ^ ctx->key_high;
+    int i = 0;
+    
+    for (; i < HITAG2_KNOWN_E_ROUNDS; i++) {
+        state = hitag2_ctx_round(state, ctx, init, i, 0);
+    }
+    for (; i < HITAG2_KNOWN_D_ROUNDS; i++) {
+        state = hitag2_ctx_round(state, ctx, init, i, HITAG2_GROUP_E);
+    }
+    for (; i < HITAG2_KNOWN_C_ROUNDS; i++) {
+        state = hitag2_ctx_round(state, ctx, init, i, HITAG2_GROUP_D | HITAG2_GROUP_E);
+    }
+    for (; i < 32; i++) {
+        state = hitag2_ctx_round(state, ctx, init, i,
+                                 HITAG2_GROUP_C | HITAG2_GROUP_D | HITAG2_GROUP_E);
+    }
+    
+    return state;
+}
+
+// Hi-Tag 2 filter functions as Boolean expressions, on 0/1 values or
+// bitwise on whole words (same formulas as the bitsliced kernels in
+// crypto_batch.c)
+#define HITAG2_CT_FA(a, b, c, d)     (~((((a) | (b)) & (c)) ^ ((a) | (d)) ^ (b)))
+#define HITAG2_CT_FB(a, b, c, d)     (~((((d) | (c)) & ((a) ^ (b))) ^ ((d) | (a) | (b))))
+#define HITAG2_CT_FC(a, b, c, d, e)  (~(((((((c) ^ (e)) | (d)) & (a)) ^ (b)) & ((c) ^ (b))) ^ \
+                                       ((((d) ^ (e)) | (a)) & (((d) ^ (b)) | (c)))))
+
+// Filter tap n of the 8 states after shifts 1-8 of window, as bits 0-7
+#define HITAG2_KS8_TAP(n)  ((uint32_t)(window >> ((n) + 1)))
+
+/*
+ * Generate the next 8 keystream bits (first bit in bit 0)
+ * 
+ * The next 8 feedback bits come from the byte tables; placed above
+ * the state they form a window whose shifts are the next 8 states.
+ * Bit k of window >> (n + 1) is state bit n after shift k + 1, so the
+ * filter formulas applied to those shifted words evaluate f20 for all
+ * 8 states at once.
+ */
+static inline uint32_t hitag2_keystream8(uint64_t* state) {
+    uint64_t window = *state | (lfsr_feedback8(*state, g_hitag2_lfsr_table) << 48);
+    
+    uint32_t a = HITAG2_CT_FA(HITAG2_KS8_TAP(1), HITAG2_KS8_TAP(2),
+                              HITAG2_KS8_TAP(4), HITAG2_KS8_TAP(5));
+    uint32_t b = HITAG2_CT_FB(HITAG2_KS8_TAP(7), HITAG2_KS8_TAP(11),
+                              HITAG2_KS8_TAP(13), HITAG2_KS8_TAP(14));
+    uint32_t c = HITAG2_CT_FB(HITAG2_KS8_TAP(16), HITAG2_KS8_TAP(20),
+                              HITAG2_KS8_TAP(22), HITAG2_KS8_TAP(25));
+    uint32_t d = HITAG2_CT_FB(HITAG2_KS8_TAP(27), HITAG2_KS8_TAP(28),
+                              HITAG2_KS8_TAP(30), HITAG2_KS8_TAP(32));
+    uint32_t e = HITAG2_CT_FA(HITAG2_KS8_TAP(33), HITAG2_KS8_TAP(42),
+                              HITAG2_KS8_TAP(43), HITAG2_KS8_TAP(45));
+    
+    *state = window >> 8;
+    return HITAG2_CT_FC(a, b, c, d, e) & 0xFF;
+}
+
+// State bit n of the 32-bit halves used by the constant-time path
+#define HITAG2_CT_LO(n)  ((lo >> (n)) & 1)
+#define HITAG2_CT_HI(n)  ((hi >> ((n) - 32)) & 1)
+
+/*
+ * Constant-time Hi-Tag 2 output filter f20
+ * 
+ * State bits 31:0 in lo, 47:32 in hi. Every shift amount is a constant
+ * and nothing is looked up, so the cost does not depend on the state.
+ */
+static inline uint32_t hitag2_filter_ct(uint32_t lo, uint32_t hi) {
+    uint32_t a = HITAG2_CT_FA(HITAG2_CT_LO(1), HITAG2_CT_LO(2), HITAG2_CT_LO(4), HITAG2_CT_LO(5));
+    uint32_t b = HITAG2_CT_FB(HITAG2_CT_LO(7), HITAG2_CT_LO(11), HITAG2_CT_LO(13), HITAG2_CT_LO(14));
+    uint32_t c = HITAG2_CT_FB(HITAG2_CT_LO(16), HITAG2_CT_LO(20), HITAG2_CT_LO(22), HITAG2_CT_LO(25));
+    uint32_t d = HITAG2_CT_FB(HITAG2_CT_LO(27), HITAG2_CT_LO(28), HITAG2_CT_LO(30), HITAG2_CT_HI(32));
+    uint32_t e = HITAG2_CT_FA(HITAG2_CT_HI(33), HITAG2_CT_HI(42), HITAG2_CT_HI(43), HITAG2_CT_HI(45));
+    
+    return HITAG2_CT_FC(a, b, c, d, e) & 1;
+}
+
+/*
+ * Constant-time Hi-Tag 2 response on 32-bit halves
+ * lo, hi: initial state (UID, Key[15:0]); init: Challenge ^ Key[47:16]
+ * state: if not NULL, receives the LFSR state after the response
+ * 
+ * Fixed trip counts, no branches, no tables and no 64-bit helpers.
+ */
+static uint32_t hitag2_response_ct(uint32_t lo, uint32_t hi, uint32_t init, uint64_t* state) {
+    const uint32_t taps_lo = (uint32_t)CRYPTO_TAPS_HITAG2;
+    const uint32_t taps_hi = (uint32_t)(CRYPTO_TAPS_HITAG2 >> 32);
+    uint32_t response = 0;
+    
+    for (int i = 0; i < 32; i++) {
+        lo = (lo >> 1) | (hi << 31);
+        hi = (hi >> 1) & 0x7FFF;
+        hi |= (hitag2_filter_ct(lo, hi) ^ ((init >> i) & 1)) << 15;
+    }
+    
+    for (int i = 0; i < 32; i++) {
+        uint32_t x = (lo & taps_lo) ^ (hi & taps_hi);
+        x ^= x >> 16;
+        x ^= x >> 8;
+        x ^= x >> 4;
+        x ^= x >> 2;
+        x ^= x >> 1;
+        
+        lo = (lo >> 1) | (hi << 31);
+        hi = ((hi >> 1) & 0x7FFF) | ((x & 1) << 15);
+        response |= hitag2_filter_ct(lo, hi) << i;
+    }
+    
+    if (state) {
+        *state = ((uint64_t)hi << 32) | lo;
+    }
+    return response;
+}
+
+// Backend registry (first entry is the reference)
+static const crypto_backend_t g_crypto_backends[] = {
+    {"bitserial", CRYPTO_CAP_HITAG2 | CRYPTO_CAP_REFERENCE, crypto_response_bitserial, 0},
+    {"table",     CRYPTO_CAP_HITAG2 | CRYPTO_CAP_TABLES,    crypto_response_table,     0},
+    {"bitslice",  CRYPTO_CAP_HITAG2 | CRYPTO_CAP_BITSLICE | CRYPTO_CAP_BATCH,
+                  crypto_response_bitslice, crypto_compute_response_batch},
+    {"v2",        CRYPTO_CAP_LEGACY,                        crypto_compute_response_v2, 0},
+    {"consttime", CRYPTO_CAP_HITAG2 | CRYPTO_CAP_CONSTTIME, crypto_response_consttime, 0},
+};
+
+#define CRYPTO_NUM_BACKENDS  (sizeof(g_crypto_backends) / sizeof(g_crypto_backends[0]))
+
+// Used until crypto_backend_calibrate() has run
+// (constant-time builds only ever use the consttime backend)
+#ifdef CRYPTO_CONSTANT_TIME
+#define CRYPTO_DEFAULT_BACKEND  4
+#else
+#define CRYPTO_DEFAULT_BACKEND  1
+#endif
+
+static const crypto_backend_t* g_crypto_backend = &g_crypto_backends[CRYPTO_DEFAULT_BACKEND];
+static crypto_backend_stats_t g_crypto_stats[CRYPTO_NUM_BACKENDS];
+static bool g_crypto_calibrated = false;
+
+// Live call profile: one slot per backend, then the ctx and auth paths
+#define CRYPTO_PROFILE_SLOTS  (CRYPTO_NUM_BACKENDS + CRYPTO_PROFILE_PATHS)
+
+#ifdef CRYPTO_PROFILE
+static crypto_profile_t g_crypto_profile[CRYPTO_PROFILE_SLOTS];
+#endif
+
+static const char* const g_crypto_profile_paths[CRYPTO_PROFILE_PATHS] = {
+    "ctx", "auth", "finish"
+};
+
+// Known answer for the reference backend
+// Key 52 4B 49 4D 4E 4F, UID 0x49434957, challenge 0x4B4E4F52
+static const uint8_t g_kat_key[6] = {0x52, 0x4B, 0x49, 0x4D, 0x4E, 0x4F};
+#define CRYPTO_KAT_UID        0x49434957UL
+#define CRYPTO_KAT_CHALLENGE  0x4B4E4F52UL
+#define CRYPTO_KAT_RESPONSE   0x6C416796UL
+
+// Number of pseudo-random vectors each backend must match
+#define CRYPTO_CHECK_VECTORS  16
+
+// Benchmark: double the iteration count until a run lasts this long
+#define CRYPTO_BENCH_MIN_US   1000
+#define CRYPTO_BENCH_MAX_ITER (1UL << 16)
+
+/*
+ * Read the benchmark timer
+ * PIC32: CP0 Count (SYSCLK/2), host: monotonic nanoseconds
+ * Only differences are used, so wrap-around is harmless.
+ */
+static inline uint32_t crypto_ticks(void) {
+#ifdef __PIC32MX__
+    return _CP0_GET_COUNT();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)ts.tv_sec * 1000000000UL + (uint32_t)ts.tv_nsec;
+#endif
+}
+
+/*
+ * Get benchmark timer ticks per microsecond
+ */
+uint32_t crypto_ticks_per_us(void) {
+#ifdef __PIC32MX__
+    return SYSCLK_COUNT_PER_US;
+#else
+    return 1000;
+#endif
+}
+
+#ifdef CRYPTO_PROFILE
+
+// Time a call: CRYPTO_PROFILE_BEGIN() before, CRYPTO_PROFILE_END(slot) after
+#define CRYPTO_PROFILE_BEGIN()    uint32_t profile_start = crypto_ticks()
+#define CRYPTO_PROFILE_END(slot)  crypto_profile_record((slot), crypto_ticks() - profile_start)
+
+/*
+ * Add one call to a profile slot
+ */
+static inline void crypto_profile_record(uint32_t slot, uint32_t ticks) {
+    crypto_profile_t* p = &g_crypto_profile[slot];
+    
+    if (p->count == 0 || ticks < p->min) {
+        p->min = ticks;
+    }
+    if (ticks > p->max) {
+        p->max = ticks;
+    }
+    p->total += ticks;
+    p->count++;
+}
+
+#else
+
+#define CRYPTO_PROFILE_BEGIN()
+#define CRYPTO_PROFILE_END(slot)
+
+#endif
+
+/*
+ * Step a xorshift32 generator (benchmark and check vectors)
+ */
+static inline uint32_t crypto_xorshift(uint32_t* seed) {
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+    return x;
+}
+
+/*
+ * Check a backend against the reference
+ * The reference itself is checked against the known answer
+ */
+static bool crypto_backend_check(const crypto_backend_t* backend) {
+    if (backend->compute(g_kat_key, CRYPTO_KAT_UID, CRYPTO_KAT_CHALLENGE) != CRYPTO_KAT_RESPONSE) {
+        return false;
+    }
+    
+    uint32_t seed = 0x2C796671UL;
+    for (int i = 0; i < CRYPTO_CHECK_VECTORS; i++) {
+        uint8_t key[6];
+        for (int j = 0; j < 6; j++) {
+            key[j] = crypto_xorshift(&seed) & 0xFF;
+        }
+        uint32_t uid = crypto_xorshift(&seed);
+        uint32_t challenge = crypto_xorshift(&seed);
+        
+        if (backend->compute(key, uid, challenge) !=
+            crypto_response_bitserial(key, uid, challenge)) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+/*
+ * Measure timer ticks per response of a backend
+ * 
+ * Calibrated: the iteration count doubles until one run lasts at
+ * least CRYPTO_BENCH_MIN_US, so the result does not depend on the
+ * clock configuration. Each challenge depends on the previous
+ * response so calls cannot be overlapped or hoisted.
+ */
+static uint32_t crypto_backend_bench(const crypto_backend_t* backend) {
+    const uint32_t min_ticks = CRYPTO_BENCH_MIN_US * crypto_ticks_per_us();
+    uint8_t key[6] = {0x4D, 0x49, 0x4B, 0x52, 0x4F, 0x4E};
+    uint32_t iterations = 8;
+    
+    for (;;) {
+        uint32_t response = 0;
+        uint32_t start = crypto_ticks();
+        
+        for (uint32_t i = 0; i < iterations; i++) {
+            response = backend->compute(key, i, response);
+        }
+        
+        uint32_t elapsed = crypto_ticks() - start;
+        key[0] ^= response & 0xFF;
+        
+        if (elapsed >= min_ticks || iterations >= CRYPTO_BENCH_MAX_ITER) {
+            uint32_t ticks = elapsed / iterations;
+            return (ticks > 0) ? ticks : 1;
+        }
+        iterations <<= 1;
+    }
+}
+
+/*
+ * Benchmark every backend and pin the fastest correct one
+ * Legacy backends are measured but never selected; constant-time
+ * builds (CRYPTO_CONSTANT_TIME) only select constant-time backends.
+ * returns: index of the selected backend
+ */
+uint8_t crypto_backend_calibrate(void) {
+    uint8_t best = CRYPTO_DEFAULT_BACKEND;
+    uint32_t best_ticks = 0;
+    
+    for (uint8_t i = 0; i < CRYPTO_NUM_BACKENDS; i++) {
+        const crypto_backend_t* backend = &g_crypto_backends[i];
+        
+        g_crypto_stats[i].correct = crypto_backend_check(backend);
+        g_crypto_stats[i].ticks = crypto_backend_bench(backend);
+        
+        DEBUG_PRINT("Crypto backend %s: %lu ticks%s\r\n", backend->name,
+            (unsigned long)g_crypto_stats[i].ticks,
+            g_crypto_stats[i].correct ? "" : " (mismatch)");
+        
+#ifdef CRYPTO_CONSTANT_TIME
+        if (!(backend->caps & CRYPTO_CAP_CONSTTIME)) {
+            continue;
+        }
+#endif
+        if (g_crypto_stats[i].correct && !(backend->caps & CRYPTO_CAP_LEGACY) &&
+            (best_ticks == 0 || g_crypto_stats[i].ticks < best_ticks)) {
+            best = i;
+            best_ticks = g_crypto_stats[i].ticks;
+        }
+    }
+    
+    g_crypto_backend = &g_crypto_backends[best];
+    g_crypto_calibrated = true;
+    DEBUG_PRINT("Crypto backend selected: %s\r\n", g_crypto_backend->name);
+    
+    return best;
+}
+
+/*
+ * Get the number of registered backends
+ */
+uint8_t crypto_backend_count(void) {
+    return CRYPTO_NUM_BACKENDS;
+}
+
+/*
+ * Get a backend descriptor
+ * returns: NULL if index is out of range
+ */
+const crypto_backend_t* crypto_backend_get(uint8_t index) {
+    if (index >= CRYPTO_NUM_BACKENDS) {
+        return 0;
+    }
+    return &g_crypto_backends[index];
+}
+
+/*
+ * Get the benchmark result of a backend
+ * returns: NULL if index is out of range
+ */
+const crypto_backend_stats_t* crypto_backend_stats(uint8_t index) {
+    if (index >= CRYPTO_NUM_BACKENDS) {
+        return 0;
+    }
+    return &g_crypto_stats[index];
+}
+
+/*
+ * Get the index of the active backend
+ */
+uint8_t crypto_backend_active(void) {
+    return (uint8_t)(g_crypto_backend - g_crypto_backends);
+}
+
+/*
+ * Pin a backend by hand
+ * returns: false if out of range or not a Hi-Tag 2 implementation
+ */
+bool crypto_backend_select(uint8_t index) {
+    if (index >= CRYPTO_NUM_BACKENDS ||
+        !(g_crypto_backends[index].caps & CRYPTO_CAP_HITAG2)) {
+        return false;
+    }
+    
+    g_crypto_backend = &g_crypto_backends[index];
+    DEBUG_PRINT("Crypto backend selected: %s\r\n", g_crypto_backend->name);
+    return true;
+}
+
+/*
+ * Get the number of profile slots
+ */
+uint8_t crypto_profile_count(void) {
+    return CRYPTO_PROFILE_SLOTS;
+}
+
+/*
+ * Get the profile slot of a crypto path
+ */
+uint8_t crypto_profile_slot(crypto_profile_path_t path) {
+    return CRYPTO_NUM_BACKENDS + path;
+}
+
+/*
+ * Get the name of a profile slot (backend name or path name)
+ * returns: NULL if slot is out of range
+ */
+const char* crypto_profile_name(uint8_t slot) {
+    if (slot < CRYPTO_NUM_BACKENDS) {
+        return g_crypto_backends[slot].name;
+    }
+    if (slot < CRYPTO_PROFILE_SLOTS) {
+        return g_crypto_profile_paths[slot - CRYPTO_NUM_BACKENDS];
+    }
+    return 0;
+}
+
+/*
+ * Copy a profile slot
+ * Taken with interrupts off on the PIC32, so a call that finishes in an
+ * interrupt cannot tear the copy.
+ * returns: false if slot is out of range or profiling is compiled out
+ */
+bool crypto_profile_get(uint8_t slot, crypto_profile_t* profile) {
+#ifdef CRYPTO_PROFILE
+    if (slot >= CRYPTO_PROFILE_SLOTS) {
+        return false;
+    }
+    
+#ifdef __PIC32MX__
+    unsigned int status = __builtin_disable_interrupts();
+    *profile = g_crypto_profile[slot];
+    if (status & 1) {
+        __builtin_enable_interrupts();
+    }
+#else
+    *profile = g_crypto_profile[slot];
+#endif
+    return true;
+#else
+    (void)slot;
+    (void)profile;
+    return false;
+#endif
+}
+
+/*
+ * Clear every profile slot
+ */
+void crypto_profile_reset(void) {
+#ifdef CRYPTO_PROFILE
+#ifdef __PIC32MX__
+    unsigned int status = __builtin_disable_interrupts();
+#endif
+    for (uint8_t i = 0; i < CRYPTO_PROFILE_SLOTS; i++) {
+        g_crypto_profile[i].count = 0;
+        g_crypto_profile[i].min = 0;
+        g_crypto_profile[i].max = 0;
+        g_crypto_profile[i].total = 0;
+    }
+#ifdef __PIC32MX__
+    if (status & 1) {
+        __builtin_enable_interrupts();
+    }
+#endif
+#endif
+}
 
 /*
  * Initialize crypto subsystem
+ * Only the first call benchmarks the backends (up to a few ms per
+ * backend); later ones, such as a soft RESET, keep the pinned choice.
  */
 void crypto_init(void) {
+    crypto_cache_invalidate();
+    if (!g_crypto_calibrated) {
+        crypto_backend_calibrate();
+    }
+    crypto_profile_reset();
     DEBUG_PRINT("Crypto subsystem initialized\r\n");
 }
 
@@ -57,6 +664,8 @@ void crypto_set_key(const uint8_t* key) {
     g_secret_key[4] = key[4];
     g_secret_key[5] = key[5];
     
+    crypto_cache_invalidate();
+    
     DEBUG_PRINT("Key set: %02X%02X%02X%02X%02X%02X\r\n",
         key[0], key[1], key[2], key[3], key[4], key[5]);
 }
@@ -82,67 +691,418 @@ void crypto_get_key(uint8_t* key) {
  * 3. Tag sends UID + response
  * 
  * LFSR initialization:
- * State[47:0] = Key[47:0] XOR (UID[31:0] || Challenge[31:0])
+ * State[31:0]  = UID[31:0]
+ * State[47:32] = Key[15:0]
+ * For i = 0 to 31:
+ *     Shift LFSR right by one
+ *     State[47] = f20(State) XOR Challenge[i] XOR Key[16 + i]
  * 
- * Response generation:
+ * Response generation (keystream):
  * For i = 0 to 31:
- *     Output bit = State[0]
- *     Shift LFSR, XOR with Output bit at each step
+ *     Clock LFSR (linear feedback into State[47])
+ *     Response[i] = f20(State)
+ * 
+ * Bit order follows the rest of the firmware: the key is packed LSB
+ * first from key[0], and bit i of each word is the i-th bit on air.
+ * 
+ * Runs on the backend pinned by crypto_backend_calibrate(); the call
+ * is timed into that backend's profile slot.
  */
 uint32_t crypto_compute_response(const uint8_t* key, uint32_t uid, uint32_t challenge) {
-    uint64_t state = 0;
+    const crypto_backend_t* backend = g_crypto_backend;
+    
+    CRYPTO_PROFILE_BEGIN();
+    uint32_t response = backend->compute(key, uid, challenge);
+    CRYPTO_PROFILE_END(backend - g_crypto_backends);
+    
+    return response;
+}
+
+/*
+ * Bit-serial Hi-Tag 2 response (reference backend)
+ * One LFSR step and one filter evaluation per bit, no tables
+ */
+uint32_t crypto_response_bitserial(const uint8_t* key, uint32_t uid, uint32_t challenge) {
+    uint32_t response = 0;
+    uint64_t key_value = key_pack(key);
+    uint64_t state = ((key_value & 0xFFFF) << 32) | uid;
+    uint32_t init = challenge ^ (uint32_t)(key_value >> 16);
+    
+    for (int i = 0; i < 32; i++) {
+        state >>= 1;
+        state |= (uint64_t)(hitag2_filter(state) ^ ((init >> i) & 1)) << 47;
+    }
+    
+    for (int i = 0; i < 32; i++) {
+        state = lfsr_hitag2_step(state);
+        response |= hitag2_filter(state) << i;
+    }
+    
+    return response;
+}
+
+/*
+ * Table-driven Hi-Tag 2 response (byte-stepped keystream)
+ */
+uint32_t crypto_response_table(const uint8_t* key, uint32_t uid, uint32_t challenge) {
+    uint64_t state = hitag2_init_state(key_pack(key), uid, challenge);
     uint32_t response = 0;
     
-    // Build initial state from key XOR (UID || Challenge)
-    // Key is 48 bits, UID || Challenge is 64 bits
-    // We use the first 48 bits of (UID || Challenge)
+    // Generate 32-bit response, one byte per iteration
+    for (int i = 0; i < 32; i += 8) {
+        response |= hitag2_keystream8(&state) << i;
+    }
     
-    // Construct key as 48-bit value
-    uint64_t key_value = ((uint64_t)key[0] << 0) |
-                         ((uint64_t)key[1] << 8) |
-                         ((uint64_t)key[2] << 16) |
-                         ((uint64_t)key[3] << 24) |
-                         ((uint64_t)key[4] << 32) |
-                         ((uint64_t)key[5] << 40);
+    return response;
+}
+
+/*
+ * Constant-time Hi-Tag 2 response
+ * Same cost for every key, UID and challenge (see hitag2_response_ct)
+ */
+uint32_t crypto_response_consttime(const uint8_t* key, uint32_t uid, uint32_t challenge) {
+    uint32_t key_low = (uint32_t)key[0] | ((uint32_t)key[1] << 8);
+    uint32_t key_high = (uint32_t)key[2] | ((uint32_t)key[3] << 8) |
+                        ((uint32_t)key[4] << 16) | ((uint32_t)key[5] << 24);
     
-    // Construct UID || Challenge (we use 48 bits)
-    uint64_t uid_challenge = challenge;  // Start with challenge
-    uid_challenge |= ((uint64_t)uid << 32);  // Add UID in upper bits
+    return hitag2_response_ct(uid, key_low, challenge ^ key_high, 0);
+}
+
+/*
+ * Precompute the key schedule of a token
+ * 
+ * Packs the key, builds the UID | Key[15:0] initial state and
+ * evaluates every first-layer filter group of the init rounds that
+ * reads only key/UID bits. Call when the key or UID changes.
+ */
+void crypto_ctx_init(crypto_ctx_t* ctx, const uint8_t* key, uint32_t uid) {
+    uint64_t key_value = key_pack(key);
+    uint64_t state = ((key_value & 0xFFFF) << 32) | uid;
     
-    // XOR with key to get initial state
-    state = key_value ^ uid_challenge;
+    ctx->state = state;
+    ctx->key_high = (uint32_t)(key_value >> 16);
     
-    // Generate 32-bit response
     for (int i = 0; i < 32; i++) {
-        // Extract LSB (this is the output bit)
-        uint8_t output_bit = state & 1;
+        uint32_t known = HITAG2_GROUP_A | HITAG2_GROUP_B;
+        if (i < HITAG2_KNOWN_C_ROUNDS) known |= HITAG2_GROUP_C;
+        if (i < HITAG2_KNOWN_D_ROUNDS) known |= HITAG2_GROUP_D;
+        if (i < HITAG2_KNOWN_E_ROUNDS) known |= HITAG2_GROUP_E;
         
-        // Set response bit
-        if (output_bit) {
-            response |= (1U << i);
+        // Bits shifted in by earlier rounds are still 0 here, and
+        // the known groups never read them
+        ctx->filter_index[i] = hitag2_filter_index(state >> (i + 1), known);
+    }
+}
+
+/*
+ * Compute an authentication response from a precomputed key schedule
+ * Same result as crypto_compute_response() for the ctx key and UID.
+ */
+uint32_t crypto_compute_response_ctx(const crypto_ctx_t* ctx, uint32_t challenge) {
+    CRYPTO_PROFILE_BEGIN();
+    uint64_t state = hitag2_init_state_ctx(ctx, challenge);
+    uint32_t response = 0;
+    
+    for (int i = 0; i < 32; i += 8) {
+        response |= hitag2_keystream8(&state) << i;
+    }
+    
+    CRYPTO_PROFILE_END(CRYPTO_NUM_BACKENDS + CRYPTO_PROFILE_CTX);
+    return response;
+}
+
+/*
+ * Start a keystream from a precomputed key schedule
+ * (see crypto_stream_init)
+ */
+void crypto_stream_init_ctx(crypto_stream_t* stream, const crypto_ctx_t* ctx,
+                            uint32_t challenge) {
+    stream->state = hitag2_init_state_ctx(ctx, challenge);
+    stream->buffer = 0;
+    stream->count = 0;
+    
+    crypto_stream_fill(stream);
+}
+
+/*
+ * Select the cache set of a (UID, challenge) pair
+ */
+static inline uint32_t crypto_cache_set(uint32_t uid, uint32_t challenge) {
+    uint32_t h = (uint32_t)(uid * 0x9E3779B1U) ^ challenge;
+    return (uint32_t)(h * 0x85EBCA6BU) >> CRYPTO_CACHE_SHIFT;
+}
+
+/*
+ * Mark a way as most recently used
+ * Ages within a set stay a permutation of 0..CRYPTO_CACHE_WAYS-1.
+ */
+static inline void crypto_cache_touch(crypto_cache_entry_t* set, int way) {
+    uint8_t age = set[way].age;
+    
+    for (int w = 0; w < CRYPTO_CACHE_WAYS; w++) {
+        if (set[w].age < age) {
+            set[w].age++;
         }
+    }
+    set[way].age = 0;
+}
+
+/*
+ * Authenticate through the cache (body of crypto_stream_auth_ctx and
+ * crypto_finish)
+ * 
+ * A hit returns the stored response and LFSR state without running
+ * the cipher; the lookahead is refilled later by the first page.
+ * A miss computes the response from the key schedule, or from fed (the
+ * state after the 32 init rounds, if already run), and replaces the
+ * least recently used way of its set.
+ * Constant-time builds skip the cache and always run the fixed-cost
+ * hitag2_response_ct(), so the reply time never depends on a hit.
+ * returns: authentication response (keystream bits 0-31)
+ */
+static inline uint32_t crypto_stream_auth_run(crypto_stream_t* stream, const crypto_ctx_t* ctx,
+                                              uint32_t challenge, const uint64_t* fed) {
+    uint32_t uid = (uint32_t)ctx->state;
+    
+    stream->buffer = 0;
+    stream->count = 0;
+    
+#ifdef CRYPTO_CONSTANT_TIME
+    // A cache hit would answer early: always run the fixed-cost path
+    (void)fed;
+    return hitag2_response_ct(uid, (uint32_t)(ctx->state >> 32), challenge ^ ctx->key_high,
+                              &stream->state);
+#else
+    crypto_cache_entry_t* set = g_crypto_cache[crypto_cache_set(uid, challenge)];
+    int victim = 0;
+    
+    for (int w = 0; w < CRYPTO_CACHE_WAYS; w++) {
+        if (set[w].valid && set[w].uid == uid && set[w].challenge == challenge) {
+            crypto_cache_touch(set, w);
+            g_crypto_cache_hits++;
+            stream->state = set[w].state;
+            return set[w].response;
+        }
+        if (!set[w].valid || (set[victim].valid && set[w].age > set[victim].age)) {
+            victim = w;
+        }
+    }
+    
+    uint64_t state = fed ? *fed : hitag2_init_state_ctx(ctx, challenge);
+    uint32_t response = 0;
+    
+    for (int i = 0; i < 32; i += 8) {
+        response |= hitag2_keystream8(&state) << i;
+    }
+    
+    set[victim].state = state;
+    set[victim].uid = uid;
+    set[victim].challenge = challenge;
+    set[victim].response = response;
+    set[victim].valid = true;
+    crypto_cache_touch(set, victim);
+    g_crypto_cache_misses++;
+    
+    stream->state = state;
+    return response;
+#endif
+}
+
+/*
+ * Authenticate and start the session keystream, using the cache
+ * The whole call, hit or miss, is timed into the auth profile slot:
+ * its max is what the RF reply delay has to cover.
+ * returns: authentication response (keystream bits 0-31)
+ */
+uint32_t crypto_stream_auth_ctx(crypto_stream_t* stream, const crypto_ctx_t* ctx,
+                                uint32_t challenge) {
+    CRYPTO_PROFILE_BEGIN();
+    uint32_t response = crypto_stream_auth_run(stream, ctx, challenge, NULL);
+    CRYPTO_PROFILE_END(CRYPTO_NUM_BACKENDS + CRYPTO_PROFILE_AUTH);
+    
+    return response;
+}
+
+/*
+ * Start an incremental initialization from a key and UID
+ * Builds the key schedule; prefer crypto_begin_ctx() with a schedule
+ * kept per token, which leaves nothing but the challenge to fold in.
+ */
+void crypto_begin(crypto_feed_t* feed, const uint8_t* key, uint32_t uid) {
+    crypto_ctx_init(&feed->own, key, uid);
+    crypto_begin_ctx(feed, &feed->own);
+}
+
+/*
+ * Start an incremental initialization from a precomputed key schedule
+ */
+void crypto_begin_ctx(crypto_feed_t* feed, const crypto_ctx_t* ctx) {
+    feed->ctx = ctx;
+    feed->state = ctx->state;
+    feed->challenge = 0;
+    feed->count = 0;
+}
+
+/*
+ * Fold the next challenge bit into the state
+ * 
+ * Runs init round i for challenge bit i, so the 32 rounds of
+ * hitag2_init_state_ctx() are spread over the RX bit periods and only
+ * the keystream is left when the last bit arrives. Evaluates the same
+ * filter groups as the batched rounds.
+ * Constant-time builds only record the bit: crypto_finish() runs the
+ * fixed-cost path on the whole challenge.
+ * returns: false if all 32 bits were already fed
+ */
+bool crypto_feed_bit(crypto_feed_t* feed, uint8_t bit) {
+    uint8_t i = feed->count;
+    
+    if (i >= 32) {
+        return false;
+    }
+    
+    feed->challenge |= (uint32_t)(bit & 1) << i;
+    feed->count = i + 1;
+    
+#ifndef CRYPTO_CONSTANT_TIME
+    uint32_t groups = 0;
+    if (i >= HITAG2_KNOWN_E_ROUNDS) groups |= HITAG2_GROUP_E;
+    if (i >= HITAG2_KNOWN_D_ROUNDS) groups |= HITAG2_GROUP_D;
+    if (i >= HITAG2_KNOWN_C_ROUNDS) groups |= HITAG2_GROUP_C;
+    
+    feed->state = hitag2_ctx_round(feed->state, feed->ctx,
+                                   feed->challenge ^ feed->ctx->key_high, i, groups);
+#endif
+    return true;
+}
+
+/*
+ * Finish an incremental initialization
+ * 
+ * Generates the response from the state left by the last
+ * crypto_feed_bit() and positions stream right after it. Missing
+ * challenge bits are fed as 0. A per-token schedule (crypto_begin_ctx)
+ * goes through the response cache like crypto_stream_auth_ctx(), so a
+ * repeated challenge skips the keystream too; the schedule
+ * crypto_begin() built for an arbitrary key never touches the cache.
+ * Timed into the finish profile slot.
+ * returns: authentication response (keystream bits 0-31)
+ */
+uint32_t crypto_finish(crypto_feed_t* feed, crypto_stream_t* stream) {
+    while (feed->count < 32) {
+        crypto_feed_bit(feed, 0);
+    }
+    
+    CRYPTO_PROFILE_BEGIN();
+    const crypto_ctx_t* ctx = feed->ctx;
+    uint32_t response = 0;
+    
+    if (ctx != &feed->own) {
+        response = crypto_stream_auth_run(stream, ctx, feed->challenge, &feed->state);
+    } else {
+        stream->buffer = 0;
+        stream->count = 0;
         
-        // Shift LFSR and inject feedback
-        // The feedback polynomial is applied based on tap bits
-        state >>= 1;
-        
-        // Compute feedback (XOR of selected taps with output)
-        // This is a simplified version - actual taps may differ
-        uint64_t feedback = 0;
+#ifdef CRYPTO_CONSTANT_TIME
+        response = hitag2_response_ct((uint32_t)ctx->state, (uint32_t)(ctx->state >> 32),
+                                      feed->challenge ^ ctx->key_high, &stream->state);
+#else
+        uint64_t state = feed->state;
         
-        // Apply tap mask (simplified version)
-        // The actual tap pattern depends on the specific Hi-Tag 2 implementation
-        if (state & 1) {
-            feedback ^= 0x80012000ULL;  // Simplified feedback pattern
+        for (int i = 0; i < 32; i += 8) {
+            response |= hitag2_keystream8(&state) << i;
         }
-        
-        // Inject feedback into MSB position
-        state |= (feedback << 47);
+        stream->state = state;
+#endif
     }
     
+    CRYPTO_PROFILE_END(CRYPTO_NUM_BACKENDS + CRYPTO_PROFILE_FINISH);
     return response;
 }
 
+/*
+ * Drop every cached response (the key has changed)
+ */
+void crypto_cache_invalidate(void) {
+    for (int s = 0; s < CRYPTO_CACHE_SETS; s++) {
+        for (int w = 0; w < CRYPTO_CACHE_WAYS; w++) {
+            g_crypto_cache[s][w].valid = false;
+            g_crypto_cache[s][w].age = w;
+        }
+    }
+}
+
+/*
+ * Get response cache hit/miss counters
+ */
+void crypto_cache_stats(uint32_t* hits, uint32_t* misses) {
+    if (hits) *hits = g_crypto_cache_hits;
+    if (misses) *misses = g_crypto_cache_misses;
+}
+
+/*
+ * Start a keystream at the first bit after initialization
+ * 
+ * The first 32 bits handed out are the authentication response; every
+ * bit after that encrypts the traffic of the session. Fills the
+ * lookahead buffer so the response and the next page are ready.
+ */
+void crypto_stream_init(crypto_stream_t* stream, const uint8_t* key,
+                        uint32_t uid, uint32_t challenge) {
+    stream->state = hitag2_init_state(key_pack(key), uid, challenge);
+    stream->buffer = 0;
+    stream->count = 0;
+    
+    crypto_stream_fill(stream);
+}
+
+/*
+ * Top up the lookahead buffer (whole bytes, up to 64 bits)
+ * Call when idle to take keystream generation off the reply path.
+ */
+void crypto_stream_fill(crypto_stream_t* stream) {
+    while (stream->count <= CRYPTO_STREAM_LOOKAHEAD - 8) {
+        stream->buffer |= (uint64_t)hitag2_keystream8(&stream->state) << stream->count;
+        stream->count += 8;
+    }
+}
+
+/*
+ * Take the next n keystream bits (n <= 32), first bit in bit 0
+ */
+static uint32_t crypto_stream_take(crypto_stream_t* stream, uint8_t n) {
+    if (stream->count < n) {
+        crypto_stream_fill(stream);
+    }
+    
+    uint32_t bits = (uint32_t)stream->buffer & (uint32_t)((1ULL << n) - 1);
+    stream->buffer >>= n;
+    stream->count -= n;
+    
+    return bits;
+}
+
+/*
+ * Get the next keystream bit
+ */
+uint8_t crypto_stream_next_bit(crypto_stream_t* stream) {
+    return (uint8_t)crypto_stream_take(stream, 1);
+}
+
+/*
+ * Get the next 8 keystream bits (first bit in bit 0)
+ */
+uint8_t crypto_stream_next_byte(crypto_stream_t* stream) {
+    return (uint8_t)crypto_stream_take(stream, 8);
+}
+
+/*
+ * Get the next 32 keystream bits (first bit in bit 0)
+ */
+uint32_t crypto_stream_next_word32(crypto_stream_t* stream) {
+    return crypto_stream_take(stream, 32);
+}
+
 /*
  * Verify authentication response (for reader emulation)
  * 
@@ -153,48 +1113,74 @@ bool crypto_verify_response(const uint8_t* key, uint32_t uid, uint32_t challenge
     return (computed == response);
 }
 
+/*
+ * Compare keystream with an expected response a byte at a time
+ * Stops at the first byte with a wrong bit; a wrong response is
+ * usually rejected after 8 of the 32 keystream bits.
+ */
+static inline bool hitag2_keystream_matches(uint64_t state, uint32_t response) {
+    for (int i = 0; i < 32; i += 8) {
+        if (hitag2_keystream8(&state) != ((response >> i) & 0xFF)) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+/*
+ * Verify a response with the table backend, rejecting early
+ */
+bool crypto_verify_response_table(const uint8_t* key, uint32_t uid, uint32_t challenge,
+                                  uint32_t response) {
+    return hitag2_keystream_matches(hitag2_init_state(key_pack(key), uid, challenge), response);
+}
+
+/*
+ * Verify a response from a precomputed key schedule, rejecting early
+ * Same result as crypto_verify_response() for the ctx key and UID.
+ */
+bool crypto_verify_response_ctx(const crypto_ctx_t* ctx, uint32_t challenge, uint32_t response) {
+    return hitag2_keystream_matches(hitag2_init_state_ctx(ctx, challenge), response);
+}
+
 /*
  * Alternative LFSR implementation using byte-level operations
  * This is closer to the actual hardware implementation
+ *
+ * Feedback taps (after the shift): bits 36, 35, 31, 21, 12
+ * Each byte of the state shifts on its own: bit 0 of a byte is dropped
+ * rather than carried into its lower neighbour (so tap 31 always reads 0).
+ * Whole bytes are stepped with g_lfsr_shift_table; any remaining
+ * bits (num_bits not a multiple of 8) are clocked one at a time.
  */
 uint32_t crypto_lfsr_shift(uint8_t* state, int num_bits) {
     uint32_t output = 0;
+    int i = 0;
     
     // State is 48 bits stored in 6 bytes (LSB first)
     // This means state[0] contains bits 0-7 (bit 0 = LSB)
+    uint64_t s = ((uint64_t)state[0] << 0) |
+                 ((uint64_t)state[1] << 8) |
+                 ((uint64_t)state[2] << 16) |
+                 ((uint64_t)state[3] << 24) |
+                 ((uint64_t)state[4] << 32) |
+                 ((uint64_t)state[5] << 40);
     
-    for (int i = 0; i < num_bits; i++) {
-        // Extract output bit (bit 0 of the state)
-        uint8_t out_bit = state[0] & 1;
-        output |= ((uint32_t)out_bit << i);
-        
-        // Shift the 48-bit state right by 1 bit
-        uint16_t carry = 0;
-        for (int j = 0; j < 6; j++) {
-            uint16_t new_carry = (state[j] & 1) << 8;  // LSB becomes carry for next byte
-            state[j] = (state[j] >> 1) | carry;
-            carry = new_carry;
-        }
-        
-        // Compute feedback based on tap bits
-        // The tap pattern is read from specific bit positions in the shifted state
-        // This is an approximation of the actual hardware
-        
-        // Simplified feedback: XOR specific bits back into MSB
-        // In real hardware, this is determined by the polynomial
-        uint8_t feedback = 0;
-        
-        // Example tap positions (may need adjustment)
-        if (state[4] & 0x10) feedback ^= 1;  // Bit 36
-        if (state[4] & 0x08) feedback ^= 1;  // Bit 35
-        if (state[3] & 0x80) feedback ^= 1;  // Bit 31
-        if (state[2] & 0x20) feedback ^= 1;  // Bit 21
-        if (state[1] & 0x10) feedback ^= 1;  // Bit 12
-        
-        // Inject feedback into MSB
-        if (feedback) {
-            state[5] |= 0x80;
-        }
+    // Every state bit leaves its byte within 8 steps, so after a
+    // whole byte only the feedback remains
+    for (; i + 8 <= num_bits; i += 8) {
+        output |= (uint32_t)(s & 0xFF) << i;
+        s = lfsr_feedback8(s, g_lfsr_shift_table) << 40;
+    }
+    
+    for (; i < num_bits; i++) {
+        output |= (uint32_t)lfsr_shift_output(s) << i;
+        s = lfsr_shift_step(s);
+    }
+    
+    for (int j = 0; j < 6; j++) {
+        state[j] = (s >> (8 * j)) & 0xFF;
     }
     
     return output;
@@ -230,30 +1216,24 @@ uint32_t crypto_compute_response_v2(const uint8_t* key, uint32_t uid, uint32_t c
 /*
  * Simple pseudo-random LFSR for testing
  * Uses a simple polynomial: x^48 + x^47 + x^45 + x^44 + 1
+ *
+ * Feedback taps (after the shift): bits 44, 31, 21, 1
+ * state: 48-bit LFSR state (bits above 47 are ignored)
  */
 uint64_t crypto_lfsr_simple(uint64_t state, int count, uint64_t* output) {
     uint64_t result = 0;
+    int i = 0;
     
-    // Simplified taps for testing: x^48 + x^47 + x^43 + x^31 + 1
-    #define TAP_FEEDBACK  0x8001BULL  // Simplified
+    state = lfsr_simple_load(state);
     
-    for (int i = 0; i < count; i++) {
-        // Extract output bit
-        result |= ((state & 1) << i);
-        
-        // Shift and apply feedback
-        state >>= 1;
-        uint64_t feedback = 0;
-        
-        // Check tap bits
-        if (state & (1ULL << 44)) feedback ^= 1;  // Tap at bit 44
-        if (state & (1ULL << 31)) feedback ^= 1;  // Tap at bit 31
-        if (state & (1ULL << 21)) feedback ^= 1;  // Tap at bit 21
-        if (state & (1ULL << 1)) feedback ^= 1;   // Tap at bit 1
-        
-        if (feedback) {
-            state |= (1ULL << 47);  // Set MSB
-        }
+    for (; i + 8 <= count; i += 8) {
+        result |= (state & 0xFF) << i;
+        state = (state >> 8) | (lfsr_feedback8(state, g_lfsr_simple_table) << 40);
+    }
+    
+    for (; i < count; i++) {
+        result |= lfsr_simple_output(state) << i;
+        state = lfsr_simple_step(state);
     }
     
     if (output) *output = state;
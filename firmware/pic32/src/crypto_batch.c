@@ -0,0 +1,360 @@
+/*
+ * Hi-Tag 2 Emulator - Bitsliced Batch Cipher Module
+ * Computes authentication responses for many (key, UID, challenge)
+ * tuples at once
+ *
+ * Bitsliced layout:
+ * Every bit position of the LFSR state is held in its own machine word,
+ * and bit L of that word belongs to tuple (lane) L. One XOR/AND/OR on a
+ * word therefore advances the same state bit of every lane together; the
+ * filter tables become small Boolean expressions on those words.
+ *
+ * Lane width follows the native word size:
+ * - PIC32: 32-bit words, 32 lanes per pass
+ * - Host:  64-bit words, 64 lanes per pass
+ *
+ * Host builds on x86 add SSE4.2, AVX2 and AVX-512 instantiations of the
+ * same kernel (2, 4 and 8 words per vector). The widest kernel the CPU
+ * supports is picked at runtime from CPUID.
+ *
+ * The lane/plane transposes cost about as much as the cipher rounds, so
+ * they run on the same vectors: one transpose converts every group of a
+ * pass. Left scalar, they held AVX-512 to a 1.3x gain over the native
+ * kernel; vectorized it is about 4x (crypto_compare).
+ */
+
+#include "crypto.h"
+#include "debug.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BS_HAVE_X86_SIMD
+#endif
+
+// Bitsliced word type (one bit per lane)
+typedef crypto_lanes_t bs_word_t;
+
+#define BS_LANES        CRYPTO_BATCH_LANES
+
+// Input planes: 48 initial state bits, then 32 bits folded in during init
+#define BS_STATE_BITS   48
+#define BS_INIT_BITS    32
+#define BS_IN_PLANES    (BS_STATE_BITS + BS_INIT_BITS)
+
+// Output planes and the plane ring used by the kernel
+// (plane t + j holds state bit j after t shifts)
+#define BS_RESP_BITS    32
+#define BS_RING         (BS_STATE_BITS + BS_INIT_BITS + BS_RESP_BITS)
+
+// Hi-Tag 2 filter functions in bitsliced form
+// Equivalent to the packed tables 0x2C79, 0x6671 and 0x7907287B
+#define BS_FA(a, b, c, d)     (~((((a) | (b)) & (c)) ^ ((a) | (d)) ^ (b)))
+#define BS_FB(a, b, c, d)     (~((((d) | (c)) & ((a) ^ (b))) ^ ((d) | (a) | (b))))
+#define BS_FC(a, b, c, d, e)  (~(((((((c) ^ (e)) | (d)) & (a)) ^ (b)) & ((c) ^ (b))) ^ \
+                                 ((((d) ^ (e)) | (a)) & (((d) ^ (b)) | (c)))))
+
+/*
+ * Scalar fallback: one crypto_compute_response() call per tuple
+ */
+static void bs_batch_scalar(const hitag2_key_t* keys, const uint32_t* uids,
+                            const uint32_t* challenges, uint32_t* responses,
+                            uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        responses[i] = crypto_compute_response(keys[i].bytes, uids[i], challenges[i]);
+    }
+}
+
+/*
+ * Scalar verify: one early-reject table verification per tuple
+ */
+static void bs_verify_scalar(const hitag2_key_t* keys, const uint32_t* uids,
+                             const uint32_t* challenges, const uint32_t* responses,
+                             bool* valid, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        valid[i] = crypto_verify_response_table(keys[i].bytes, uids[i], challenges[i],
+                                                responses[i]);
+    }
+}
+
+// Native word: BS_LANES lanes
+#define BS_NAME(x)  bs_native_##x
+#define BS_VEC      bs_word_t
+#define BS_GROUPS   1
+#define BS_ATTR
+#include "crypto_bs_kernel.inc"
+#undef BS_NAME
+#undef BS_VEC
+#undef BS_GROUPS
+#undef BS_ATTR
+
+#ifdef BS_HAVE_X86_SIMD
+
+// SSE4.2: 2 x 64 lanes
+typedef bs_word_t bs_v128_t __attribute__((vector_size(16)));
+#define BS_NAME(x)  bs_sse42_##x
+#define BS_VEC      bs_v128_t
+#define BS_GROUPS   2
+#define BS_ATTR     __attribute__((target("sse4.2")))
+#include "crypto_bs_kernel.inc"
+#undef BS_NAME
+#undef BS_VEC
+#undef BS_GROUPS
+#undef BS_ATTR
+
+// AVX2: 4 x 64 lanes
+typedef bs_word_t bs_v256_t __attribute__((vector_size(32)));
+#define BS_NAME(x)  bs_avx2_##x
+#define BS_VEC      bs_v256_t
+#define BS_GROUPS   4
+#define BS_ATTR     __attribute__((target("avx2")))
+#include "crypto_bs_kernel.inc"
+#undef BS_NAME
+#undef BS_VEC
+#undef BS_GROUPS
+#undef BS_ATTR
+
+// AVX-512: 8 x 64 lanes
+typedef bs_word_t bs_v512_t __attribute__((vector_size(64)));
+#define BS_NAME(x)  bs_avx512_##x
+#define BS_VEC      bs_v512_t
+#define BS_GROUPS   8
+#define BS_ATTR     __attribute__((target("avx512f")))
+#include "crypto_bs_kernel.inc"
+#undef BS_NAME
+#undef BS_VEC
+#undef BS_GROUPS
+#undef BS_ATTR
+
+#endif // BS_HAVE_X86_SIMD
+
+// Batch kernel table (indexed by crypto_kernel_t)
+
+typedef void (*bs_verify_fn_t)(const hitag2_key_t* keys, const uint32_t* uids,
+                               const uint32_t* challenges, const uint32_t* responses,
+                               bool* valid, uint32_t count);
+
+static const struct {
+    const char* name;
+    crypto_batch_fn_t fn;
+    bs_verify_fn_t verify;
+} g_bs_kernels[CRYPTO_KERNEL_COUNT] = {
+    [CRYPTO_KERNEL_SCALAR]   = {"scalar",   bs_batch_scalar, bs_verify_scalar},
+    [CRYPTO_KERNEL_BITSLICE] = {"bitslice", bs_native_batch, bs_native_verify},
+#ifdef BS_HAVE_X86_SIMD
+    [CRYPTO_KERNEL_SSE42]    = {"sse4.2",   bs_sse42_batch,  bs_sse42_verify},
+    [CRYPTO_KERNEL_AVX2]     = {"avx2",     bs_avx2_batch,   bs_avx2_verify},
+    [CRYPTO_KERNEL_AVX512]   = {"avx512",   bs_avx512_batch, bs_avx512_verify},
+#else
+    [CRYPTO_KERNEL_SSE42]    = {"sse4.2",   0, 0},
+    [CRYPTO_KERNEL_AVX2]     = {"avx2",     0, 0},
+    [CRYPTO_KERNEL_AVX512]   = {"avx512",   0, 0},
+#endif
+};
+
+// Active kernel (chosen on first use)
+static crypto_kernel_t g_bs_kernel = CRYPTO_KERNEL_COUNT;
+
+/*
+ * Compute a single response with the native bitsliced kernel
+ * (crypto backend "bitslice"; one lane of a full pass)
+ */
+uint32_t crypto_response_bitslice(const uint8_t* key, uint32_t uid, uint32_t challenge) {
+    hitag2_key_t k;
+    uint32_t response;
+
+    for (int i = 0; i < 6; i++) {
+        k.bytes[i] = key[i];
+    }
+
+    bs_native_batch(&k, &uid, &challenge, &response, 1);
+    return response;
+}
+
+/*
+ * Prepare a token bank for crypto_multi_response()
+ *
+ * keys, uids: count tokens, one lane each
+ * The bank is transposed here once, so answering a challenge needs
+ * no per-key setup.
+ * returns: false if count exceeds CRYPTO_MULTI_MAX
+ */
+bool crypto_multi_init(crypto_multi_t* multi, const hitag2_key_t* keys,
+                       const uint32_t* uids, uint32_t count) {
+    bs_native_plane_t planes[BS_IN_PLANES];
+    uint32_t challenges[BS_LANES];
+
+    if (count > CRYPTO_MULTI_MAX) {
+        return false;
+    }
+
+    // A zero challenge leaves Key[47:16] alone in the init planes
+    for (uint32_t i = 0; i < count; i++) {
+        challenges[i] = 0;
+    }
+    bs_native_load(planes, keys, uids, challenges, count);
+
+    multi->count = count;
+    for (unsigned b = 0; b < BS_STATE_BITS; b++) {
+        multi->state[b] = planes[b].v;
+    }
+    for (unsigned b = 0; b < BS_INIT_BITS; b++) {
+        multi->key_high[b] = planes[BS_STATE_BITS + b].v;
+    }
+    return true;
+}
+
+/*
+ * Compute the response of every token in a bank to one challenge
+ *
+ * A challenge bit is the same in every lane, so it is folded into the
+ * key planes as an all-ones or all-zeros word: one native bitsliced
+ * pass (32 lanes on the PIC32's 32-bit ALU, 64 on the host) answers
+ * the whole bank for the cost of a few scalar responses.
+ * responses: multi->count outputs, in bank order
+ */
+void crypto_multi_response(const crypto_multi_t* multi, uint32_t challenge,
+                           uint32_t* responses) {
+    bs_native_plane_t in[BS_IN_PLANES];
+    bs_native_plane_t out[BS_RESP_BITS];
+
+    for (unsigned b = 0; b < BS_STATE_BITS; b++) {
+        in[b].v = multi->state[b];
+    }
+    for (unsigned b = 0; b < BS_INIT_BITS; b++) {
+        bs_word_t fold = (bs_word_t)0 - ((challenge >> b) & 1);
+        in[BS_STATE_BITS + b].v = multi->key_high[b] ^ fold;
+    }
+
+    bs_native_kernel(in, out);
+    bs_native_store(out, responses, multi->count);
+}
+
+/*
+ * Check whether a batch kernel can run on this CPU
+ */
+bool crypto_batch_kernel_supported(crypto_kernel_t kernel) {
+    if (kernel >= CRYPTO_KERNEL_COUNT || !g_bs_kernels[kernel].fn) {
+        return false;
+    }
+
+#ifdef BS_HAVE_X86_SIMD
+    __builtin_cpu_init();
+    switch (kernel) {
+        case CRYPTO_KERNEL_SSE42:
+            return __builtin_cpu_supports("sse4.2");
+        case CRYPTO_KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2");
+        case CRYPTO_KERNEL_AVX512:
+            return __builtin_cpu_supports("avx512f");
+        default:
+            break;
+    }
+#endif
+
+    return true;
+}
+
+/*
+ * Get the printable name of a batch kernel
+ */
+const char* crypto_batch_kernel_name(crypto_kernel_t kernel) {
+    if (kernel >= CRYPTO_KERNEL_COUNT) {
+        return "none";
+    }
+    return g_bs_kernels[kernel].name;
+}
+
+/*
+ * Force a specific batch kernel
+ * returns: false if the kernel is not supported here
+ */
+bool crypto_batch_set_kernel(crypto_kernel_t kernel) {
+    if (!crypto_batch_kernel_supported(kernel)) {
+        return false;
+    }
+
+    g_bs_kernel = kernel;
+    DEBUG_PRINT("Batch kernel: %s\r\n", g_bs_kernels[kernel].name);
+    return true;
+}
+
+/*
+ * Get the active batch kernel, selecting the widest supported one
+ * on first use
+ */
+crypto_kernel_t crypto_batch_get_kernel(void) {
+    if (g_bs_kernel == CRYPTO_KERNEL_COUNT) {
+        crypto_kernel_t kernel = CRYPTO_KERNEL_COUNT;
+        do {
+            kernel--;
+        } while (kernel > CRYPTO_KERNEL_BITSLICE && !crypto_batch_kernel_supported(kernel));
+        crypto_batch_set_kernel(kernel);
+    }
+    return g_bs_kernel;
+}
+
+/*
+ * Compute authentication responses for a batch of tuples
+ *
+ * keys, uids, challenges: count input tuples
+ * responses: count output responses
+ *
+ * Results are bit-identical to calling crypto_compute_response() on
+ * each tuple, whichever kernel is active.
+ */
+void crypto_compute_response_batch(const hitag2_key_t* keys, const uint32_t* uids,
+                                   const uint32_t* challenges, uint32_t* responses,
+                                   uint32_t count) {
+    g_bs_kernels[crypto_batch_get_kernel()].fn(keys, uids, challenges, responses, count);
+}
+
+// Candidates per kernel call when a shared key is spread over the lanes
+#define BS_VERIFY_CHUNK  256
+
+/*
+ * Verify a batch of candidate responses
+ *
+ * keys: one shared key (num_keys == 1) or one per candidate
+ * uids, challenges, responses: count candidates
+ * valid: count results, identical to crypto_verify_response()
+ *
+ * Full passes go through the active batch kernel, which stops once
+ * every lane has a wrong bit. A shared key with fewer candidates than a
+ * pass (reader emulation) is scheduled once per UID instead and each
+ * candidate checked with crypto_verify_response_ctx().
+ * returns: number of valid candidates
+ */
+uint32_t crypto_verify_response_batch(const hitag2_key_t* keys, uint32_t num_keys,
+                                      const uint32_t* uids, const uint32_t* challenges,
+                                      const uint32_t* responses, bool* valid,
+                                      uint32_t count) {
+    bs_verify_fn_t verify = g_bs_kernels[crypto_batch_get_kernel()].verify;
+    uint32_t matches = 0;
+
+    if (num_keys != 1) {
+        verify(keys, uids, challenges, responses, valid, count);
+    } else if (count < BS_LANES) {
+        crypto_ctx_t ctx;
+
+        for (uint32_t i = 0; i < count; i++) {
+            if (i == 0 || uids[i] != uids[i - 1]) {
+                crypto_ctx_init(&ctx, keys[0].bytes, uids[i]);
+            }
+            valid[i] = crypto_verify_response_ctx(&ctx, challenges[i], responses[i]);
+        }
+    } else {
+        hitag2_key_t shared[BS_VERIFY_CHUNK];
+
+        for (uint32_t i = 0; i < BS_VERIFY_CHUNK; i++) {
+            shared[i] = keys[0];
+        }
+        for (uint32_t i = 0; i < count; i += BS_VERIFY_CHUNK) {
+            uint32_t n = (count - i < BS_VERIFY_CHUNK) ? count - i : BS_VERIFY_CHUNK;
+            verify(shared, uids + i, challenges + i, responses + i, valid + i, n);
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        matches += valid[i];
+    }
+    return matches;
+}
@@ -0,0 +1,127 @@
+/*
+ * Hi-Tag 2 Emulator - LFSR Jump-Ahead Module
+ * Advances a 48-bit LFSR by any number of steps in O(log n)
+ *
+ * One LFSR step is linear over GF(2), so it is a 48x48 bit matrix M and
+ * n steps are M^n. The powers M^(2^k), k = 0..47, are built once per tap
+ * configuration by repeated squaring; a jump then applies one power per
+ * set bit of n, at most 48 matrix-vector products for n < 2^48.
+ *
+ * Matrices are stored by column: col[i] is the image of State[i], and
+ * M * v is the XOR of the columns selected by the bits of v.
+ *
+ * The cache is filled on first use of a tap configuration and is not
+ * locked; multithreaded hosts should make one jump per configuration
+ * before starting their workers.
+ */
+
+#include "crypto.h"
+#include "crypto_tables.h"
+#include "debug.h"
+
+#define JUMP_STATE_BITS  48
+#define JUMP_STATE_MASK  0xFFFFFFFFFFFFULL
+
+// Cached tap configurations (18 KB each)
+// PIC32 builds keep one; unused caches are dropped by --gc-sections
+#if defined(__PIC32MX__)
+#define JUMP_CACHE_SLOTS  1
+#else
+#define JUMP_CACHE_SLOTS  4
+#endif
+
+// Powers M^(2^k) of one tap configuration
+typedef struct {
+    bool valid;
+    uint64_t taps;
+    uint64_t power[JUMP_STATE_BITS][JUMP_STATE_BITS];
+} jump_cache_t;
+
+static jump_cache_t g_jump_cache[JUMP_CACHE_SLOTS];
+static uint8_t g_jump_next = 0;  // Next slot to replace (round robin)
+
+/*
+ * Multiply a column-stored matrix by a state vector
+ */
+static uint64_t jump_apply(const uint64_t* col, uint64_t v) {
+    uint64_t r = 0;
+
+    for (int i = 0; i < JUMP_STATE_BITS; i++) {
+        r ^= col[i] & (0 - ((v >> i) & 1));
+    }
+    return r;
+}
+
+/*
+ * Find or build the power table for a tap configuration
+ */
+static const jump_cache_t* jump_lookup(uint64_t taps) {
+    for (int s = 0; s < JUMP_CACHE_SLOTS; s++) {
+        if (g_jump_cache[s].valid && g_jump_cache[s].taps == taps) {
+            return &g_jump_cache[s];
+        }
+    }
+
+    jump_cache_t* entry = &g_jump_cache[g_jump_next];
+    g_jump_next = (g_jump_next + 1) % JUMP_CACHE_SLOTS;
+
+    entry->valid = false;
+    entry->taps = taps;
+
+    // M: State[i] moves to State[i - 1] and feeds State[47] if tapped
+    for (int i = 0; i < JUMP_STATE_BITS; i++) {
+        entry->power[0][i] = ((i > 0) ? (1ULL << (i - 1)) : 0) |
+                             (((taps >> i) & 1) << 47);
+    }
+
+    // M^(2^k) = M^(2^(k-1)) squared
+    for (int k = 1; k < JUMP_STATE_BITS; k++) {
+        for (int i = 0; i < JUMP_STATE_BITS; i++) {
+            entry->power[k][i] = jump_apply(entry->power[k - 1], entry->power[k - 1][i]);
+        }
+    }
+
+    entry->valid = true;
+    DEBUG_PRINT("LFSR jump table built for taps %08lX%04X\r\n",
+        (unsigned long)(taps >> 16), (unsigned)(taps & 0xFFFF));
+
+    return entry;
+}
+
+/*
+ * Advance a 48-bit LFSR by n steps
+ *
+ * state: 48-bit LFSR state (bits above 47 are ignored)
+ * n: number of steps
+ * taps: pre-shift tap mask, bit N set when State[N] feeds State[47]
+ *       (one step is State = (State >> 1) | (parity(State & taps) << 47))
+ * returns: the state after n steps
+ */
+uint64_t crypto_lfsr_jump_taps(uint64_t state, uint64_t n, uint64_t taps) {
+    const jump_cache_t* entry = jump_lookup(taps & JUMP_STATE_MASK);
+
+    state &= JUMP_STATE_MASK;
+
+    // Beyond 2^48 steps (longer than the LFSR period): whole 2^48 blocks
+    while (n >> JUMP_STATE_BITS) {
+        state = jump_apply(entry->power[JUMP_STATE_BITS - 1], state);
+        state = jump_apply(entry->power[JUMP_STATE_BITS - 1], state);
+        n -= 1ULL << JUMP_STATE_BITS;
+    }
+
+    for (int k = 0; n != 0; k++, n >>= 1) {
+        if (n & 1) {
+            state = jump_apply(entry->power[k], state);
+        }
+    }
+
+    return state;
+}
+
+/*
+ * Advance the Hi-Tag 2 LFSR by n steps (keystream clocking, no filter
+ * feedback; use after initialization)
+ */
+uint64_t crypto_lfsr_jump(uint64_t state, uint64_t n) {
+    return crypto_lfsr_jump_taps(state, n, CRYPTO_TAPS_HITAG2);
+}
@@ -0,0 +1,62 @@
+/*
+ * Hi-Tag 2 Emulator - LFSR Family
+ * Bit-level step functions generated per variant from one list
+ *
+ * Every LFSR in the crypto module is a right-shifting linear register:
+ *   State' = ((State >> 1) & KEEP) | (parity(State & TAPS) << (WIDTH - 1))
+ *   Output = State[OUT] before the step
+ * KEEP is the width mask for an ordinary register; crypto_lfsr_shift
+ * drops the carry between bytes, so its KEEP clears bit 7 of every byte.
+ *
+ * CRYPTO_LFSR_FAMILY lists the variants as
+ *   X(name, WIDTH, TAPS, OUT, KEEP)
+ * and CRYPTO_LFSR_DEFINE generates for each one:
+ *   lfsr_<name>_load(state)      state truncated to WIDTH bits
+ *   lfsr_<name>_feedback(state)  new top bit (parity of the taps)
+ *   lfsr_<name>_step(state)      one step
+ *   lfsr_<name>_output(state)    output bit
+ * All parameters are constants, so each instance compiles to a few
+ * AND/shift/XOR instructions with no branches and no tap tests; the
+ * parity fold only keeps the levels WIDTH needs.
+ *
+ * A manufacturer variant with other taps is one more row here. The tap
+ * masks of the existing rows come from tools/gen_crypto_tables.c, which
+ * derives them (and the byte-stepping tables) from bit-serial references.
+ */
+
+#ifndef CRYPTO_LFSR_H
+#define CRYPTO_LFSR_H
+
+#include <stdint.h>
+
+#include "crypto_tables.h"
+
+#define CRYPTO_LFSR_FAMILY(X) \
+    X(hitag2, 48, CRYPTO_TAPS_HITAG2, 0, 0xFFFFFFFFFFFFULL) \
+    X(shift,  48, CRYPTO_TAPS_SHIFT,  0, 0x7F7F7F7F7F7FULL) \
+    X(simple, 48, CRYPTO_TAPS_SIMPLE, 0, 0xFFFFFFFFFFFFULL)
+
+#define CRYPTO_LFSR_DEFINE(name, width, taps, out, keep) \
+    static inline uint64_t lfsr_##name##_load(uint64_t state) { \
+        return ((width) < 64) ? (state & ((1ULL << ((width) & 63)) - 1)) : state; \
+    } \
+    static inline uint64_t lfsr_##name##_feedback(uint64_t state) { \
+        uint64_t x = state & (taps); \
+        if ((width) > 32) x ^= x >> 32; \
+        if ((width) > 16) x ^= x >> 16; \
+        if ((width) > 8)  x ^= x >> 8; \
+        if ((width) > 4)  x ^= x >> 4; \
+        if ((width) > 2)  x ^= x >> 2; \
+        x ^= x >> 1; \
+        return x & 1; \
+    } \
+    static inline uint64_t lfsr_##name##_step(uint64_t state) { \
+        return ((state >> 1) & (keep)) | (lfsr_##name##_feedback(state) << ((width) - 1)); \
+    } \
+    static inline uint64_t lfsr_##name##_output(uint64_t state) { \
+        return (state >> (out)) & 1; \
+    }
+
+CRYPTO_LFSR_FAMILY(CRYPTO_LFSR_DEFINE)
+
+#endif // CRYPTO_LFSR_H
@@ -0,0 +1,82 @@
+/*
+ * Hi-Tag 2 Emulator - Flash Module
+ * NVM controller access for the token store region
+ *
+ * Every operation stalls the CPU while the flash array is busy (code
+ * runs from the same flash): about 20 µs per word and 20 ms per page
+ * erase. Callers keep flash work out of emulation, where it would miss
+ * the RF response window.
+ */
+
+#include "flash.h"
+#include "clock.h"
+
+#include <xc.h>
+
+// NVMCON operations
+#define NVMOP_WORD_PGM    0x1
+#define NVMOP_PAGE_ERASE  0x4
+
+// Low-voltage detect start-up after WREN: 6 µs of CP0 Count
+#define FLASH_LVD_TICKS   (6 * SYSCLK_COUNT_PER_US)
+
+// Uncached view of the region: reads see what was just programmed
+#define FLASH_KSEG1(offset)  ((volatile const uint32_t*)(0xA0000000UL | (FLASH_STORE_BASE + (offset))))
+
+/*
+ * Run one NVM operation with the unlock sequence
+ * Interrupts stay off from unlock to WR, as the sequence requires.
+ */
+static bool flash_nvm_op(uint32_t op) {
+    unsigned int status = __builtin_disable_interrupts();
+
+    NVMCON = _NVMCON_WREN_MASK | op;
+
+    uint32_t start = _CP0_GET_COUNT();
+    while ((uint32_t)(_CP0_GET_COUNT() - start) < FLASH_LVD_TICKS);
+
+    NVMKEY = 0xAA996655;
+    NVMKEY = 0x556699AA;
+    NVMCONSET = _NVMCON_WR_MASK;
+
+    while (NVMCON & _NVMCON_WR_MASK);
+
+    NVMCONCLR = _NVMCON_WREN_MASK;
+
+    if (status & 1) {
+        __builtin_enable_interrupts();
+    }
+
+    return !(NVMCON & (_NVMCON_WRERR_MASK | _NVMCON_LVDERR_MASK));
+}
+
+/*
+ * Size of the token store region
+ */
+uint32_t flash_size(void) {
+    return FLASH_STORE_SIZE;
+}
+
+/*
+ * Read a word of the region
+ */
+uint32_t flash_read_word(uint32_t offset) {
+    return *FLASH_KSEG1(offset);
+}
+
+/*
+ * Program one word
+ */
+bool flash_write_word(uint32_t offset, uint32_t word) {
+    NVMADDR = FLASH_STORE_BASE + offset;
+    NVMDATA = word;
+    return flash_nvm_op(NVMOP_WORD_PGM);
+}
+
+/*
+ * Erase the page holding offset
+ */
+bool flash_erase_page(uint32_t offset) {
+    NVMADDR = FLASH_STORE_BASE + (offset & ~(uint32_t)(FLASH_PAGE_SIZE - 1));
+    return flash_nvm_op(NVMOP_PAGE_ERASE);
+}
@@ -7,9 +7,11 @@
  */
 
 #include "main.h"
+#include "clock.h"
 #include "rf_driver.h"
 #include "crypto.h"
 #include "memory.h"
+#include "token_store.h"
 #include "spi_slave.h"
 #include "debug.h"
 
@@ -49,6 +51,13 @@ void system_init(void) {
     // Initialize memory subsystem
     memory_init();
     
+    // Bring back the bank slots saved in flash
+    if (token_store_init()) {
+        memory_epoch_advance();
+        memory_bank_restore();
+        g_app_state.token_loaded = memory_bank_used(memory_bank_active());
+    }
+    
     // Initialize SPI slave
     spi_slave_init();
     
@@ -216,10 +225,10 @@ void system_delay_ms(uint32_t ms) {
  * Note: Uses busy-wait, not precise but sufficient for this application
  */
 void system_delay_us(uint32_t us) {
-    // At 80 MHz, each cycle is 12.5 ns
+    // One loop pass per SYSCLK cycle, roughly
     // For reasonable delays, use a loop
     // For precise timing, use hardware timers
-    volatile uint32_t cycles = us * 80;  // 80 cycles per microsecond
+    volatile uint32_t cycles = us * (SYSCLK_HZ / 1000000UL);
     while (cycles > 0) {
         cycles--;
     }
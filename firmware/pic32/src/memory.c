@@ -4,16 +4,111 @@
  */
 
 #include "memory.h"
+#include "crypto.h"
+#include "token_store.h"
 #include "debug.h"
+#include <stddef.h>
 
-// Memory pages (8 × 32 bits = 256 bits)
-static page_t g_pages[NUM_PAGES];
+// One token of the bank: its pages and key schedule
+// The 8-byte aligned ctx goes first so store and used share one tail of
+// padding: 48 + 36 + 1 rounds to 88 bytes, not 96.
+typedef struct {
+    crypto_ctx_t ctx;           // Rebuilt when key or UID changes
+    page_store_t store;         // 8 × 32 bits = 256 bits + writable mask
+    bool used;                  // Loaded since memory_init()
+} memory_slot_t;
+
+// Tokens that fit in the RAM share given to the bank
+#define MEMORY_BANK_SLOTS  (MEMORY_BANK_BYTES / sizeof(memory_slot_t))
+
+// Token bank; slot 0 is active after memory_init()
+static memory_slot_t g_bank[MEMORY_BANK_SLOTS];
+
+// Active token: everything below works through these two pointers, so
+// selecting another slot is a pointer swap
+static memory_slot_t* g_active = &g_bank[0];
+static uint32_t* g_pages = g_bank[0].store.data;
+
+// Bitsliced copy of the bank window memory_bank_auth() last answered
+// for (first slot), transposed once and kept until a key or UID changes
+#define MEMORY_MULTI_NONE  0xFFFF
+static crypto_multi_t g_multi;
+static uint16_t g_multi_first = MEMORY_MULTI_NONE;
+
+// Crypto-mode session (started by START_AUTH)
+static crypto_stream_t g_auth_stream;
+static crypto_feed_t g_auth_feed;
+static bool g_auth_active = false;
+
+// Page transaction (memory_txn_*): new page values, a bit per page
+// written, and the slot it was started on
+static uint32_t g_txn_shadow[NUM_PAGES];
+static uint8_t g_txn_written = 0;
+static memory_slot_t* g_txn_slot = NULL;
+
+// Change tracking for delta sync: a counter bumped by every change and
+// the generation at which each page of the active token last changed.
+// Kept across memory_init() so RESET never moves it backwards; a power
+// cycle, brownout or watchdog reset does restart it, so syncs also carry
+// the boot epoch (a boot count kept in the token store under a key past
+// the bank slots) and a new epoch means a full resync.
+#define MEMORY_ALL_PAGES  ((1U << NUM_PAGES) - 1)
+#define MEMORY_EPOCH_KEY  (TOKEN_STORE_KEYS - 1)
+static uint32_t g_generation = 0;
+static uint32_t g_page_generation[NUM_PAGES];
+static uint32_t g_epoch = 0;
+
+_Static_assert(MEMORY_BANK_SLOTS <= MEMORY_EPOCH_KEY, "bank slots overlap the epoch key");
+
+/*
+ * Record a change to the pages in mask (bit n: page n)
+ */
+static void memory_touch(uint8_t mask) {
+    g_generation++;
+    for (int i = 0; i < NUM_PAGES; i++) {
+        if ((mask >> i) & 1) {
+            g_page_generation[i] = g_generation;
+        }
+    }
+}
+
+/*
+ * Extract the 48-bit key of a token from its pages
+ */
+static void memory_pages_key(const uint32_t* pages, uint8_t* key) {
+    // Page 2: Key bits 0-31
+    uint32_t key_low = pages[2];
+    
+    // Page 3: Key bits 32-47 (upper 16 bits) + Password (lower 16 bits)
+    uint32_t key_high = pages[3];
+    
+    key[0] = (key_low >> 0) & 0xFF;
+    key[1] = (key_low >> 8) & 0xFF;
+    key[2] = (key_low >> 16) & 0xFF;
+    key[3] = (key_low >> 24) & 0xFF;
+    key[4] = (key_high >> 16) & 0xFF;  // Bits 32-39
+    key[5] = (key_high >> 24) & 0xFF;  // Bits 40-47
+}
+
+/*
+ * Rebuild the token key schedule and end any session
+ * Call whenever page 0 (UID) or pages 2-3 (key) change.
+ */
+static void memory_key_changed(void) {
+    uint8_t key[6];
+    memory_get_key(key);
+    crypto_ctx_init(&g_active->ctx, key, g_pages[0]);
+    crypto_cache_invalidate();
+    memory_auth_stop();
+    g_multi_first = MEMORY_MULTI_NONE;
+}
 
 // Default configuration for Paxton NET2
 #define DEFAULT_CONFIG  0x00000000
 #define DEFAULT_KEY     {0x00, 0x00, 0x00, 0x00, 0x00, 0x00}
 
 // Read-only pages (factory programmed)
+// Folded into each slot's writable mask by memory_init()
 static const bool g_page_writable[NUM_PAGES] = {
     false,  // Page 0: UID (read-only)
     true,   // Page 1: Configuration
@@ -31,13 +126,42 @@ static const bool g_page_writable[NUM_PAGES] = {
 void memory_init(void) {
     DEBUG_PRINT("Initializing memory subsystem...\r\n");
     
-    // Initialize all pages to zero
+    uint8_t writable = 0;
     for (int i = 0; i < NUM_PAGES; i++) {
-        g_pages[i].data = 0;
-        g_pages[i].writable = g_page_writable[i];
+        writable |= (uint8_t)(g_page_writable[i] << i);
     }
     
-    DEBUG_PRINT("Memory initialized: %d pages × %d bits\r\n", NUM_PAGES, PAGE_SIZE);
+    // Initialize all pages of every slot to zero
+    for (unsigned s = 0; s < MEMORY_BANK_SLOTS; s++) {
+        for (int i = 0; i < NUM_PAGES; i++) {
+            g_bank[s].store.data[i] = 0;
+        }
+        g_bank[s].store.writable = writable;
+        g_bank[s].used = false;
+    }
+    
+    g_active = &g_bank[0];
+    g_pages = g_active->store.data;
+    g_txn_slot = NULL;
+    
+    memory_key_changed();
+    memory_touch(MEMORY_ALL_PAGES);
+    
+    DEBUG_PRINT("Memory initialized: %d pages × %d bits, %u bank slots\r\n",
+        NUM_PAGES, PAGE_SIZE, (unsigned)MEMORY_BANK_SLOTS);
+}
+
+/*
+ * Unpack a token image into pages
+ * Each page is 4 bytes (32 bits), little-endian
+ */
+static void memory_image_load(uint32_t* pages, const uint8_t* buffer) {
+    for (int i = 0; i < NUM_PAGES; i++) {
+        pages[i] = ((uint32_t)buffer[i * 4 + 0] << 0) |
+                   ((uint32_t)buffer[i * 4 + 1] << 8) |
+                   ((uint32_t)buffer[i * 4 + 2] << 16) |
+                   ((uint32_t)buffer[i * 4 + 3] << 24);
+    }
 }
 
 /*
@@ -50,33 +174,208 @@ void memory_load_token(const uint8_t* buffer, uint16_t len) {
         return;
     }
     
+    memory_image_load(g_pages, buffer);
+    g_active->used = true;
+    
+    memory_key_changed();
+    memory_touch(MEMORY_ALL_PAGES);
+    
+    DEBUG_PRINT("Token loaded: UID=%08X\r\n", g_pages[0]);
+}
+
+/*
+ * Pack pages into a token image
+ */
+static void memory_image_save(const uint32_t* pages, uint8_t* buffer) {
     for (int i = 0; i < NUM_PAGES; i++) {
-        // Each page is 4 bytes (32 bits), little-endian
-        g_pages[i].data = ((uint32_t)buffer[i * 4 + 0] << 0) |
-                          ((uint32_t)buffer[i * 4 + 1] << 8) |
-                          ((uint32_t)buffer[i * 4 + 2] << 16) |
-                          ((uint32_t)buffer[i * 4 + 3] << 24);
+        buffer[i * 4 + 0] = (pages[i] >> 0) & 0xFF;
+        buffer[i * 4 + 1] = (pages[i] >> 8) & 0xFF;
+        buffer[i * 4 + 2] = (pages[i] >> 16) & 0xFF;
+        buffer[i * 4 + 3] = (pages[i] >> 24) & 0xFF;
     }
-    
-    DEBUG_PRINT("Token loaded: UID=%08X\r\n", g_pages[0].data);
 }
 
 /*
  * Save token data to buffer
  */
 void memory_save_token(uint8_t* buffer, uint16_t* len) {
-    for (int i = 0; i < NUM_PAGES; i++) {
-        buffer[i * 4 + 0] = (g_pages[i].data >> 0) & 0xFF;
-        buffer[i * 4 + 1] = (g_pages[i].data >> 8) & 0xFF;
-        buffer[i * 4 + 2] = (g_pages[i].data >> 16) & 0xFF;
-        buffer[i * 4 + 3] = (g_pages[i].data >> 24) & 0xFF;
-    }
+    memory_image_save(g_pages, buffer);
     
     if (len) {
         *len = NUM_PAGES * 4;
     }
 }
 
+/*
+ * Get the number of token slots in the bank
+ */
+uint16_t memory_bank_slots(void) {
+    return MEMORY_BANK_SLOTS;
+}
+
+/*
+ * Get the active slot
+ */
+uint16_t memory_bank_active(void) {
+    return (uint16_t)(g_active - g_bank);
+}
+
+/*
+ * Load a token image into a slot
+ * 
+ * Builds the slot's key schedule here, so selecting it later needs no
+ * crypto work. Loading the active slot is the same as
+ * memory_load_token().
+ * returns: false if slot is out of range or the image is short
+ */
+bool memory_bank_load(uint16_t slot, const uint8_t* buffer, uint16_t len) {
+    if (slot >= MEMORY_BANK_SLOTS || len < NUM_PAGES * 4) {
+        return false;
+    }
+    
+    memory_slot_t* target = &g_bank[slot];
+    if (target == g_active) {
+        memory_load_token(buffer, len);
+        return true;
+    }
+    
+    uint8_t key[6];
+    memory_image_load(target->store.data, buffer);
+    
+    key[0] = buffer[8];
+    key[1] = buffer[9];
+    key[2] = buffer[10];
+    key[3] = buffer[11];
+    key[4] = buffer[14];
+    key[5] = buffer[15];
+    crypto_ctx_init(&target->ctx, key, target->store.data[0]);
+    target->used = true;
+    g_multi_first = MEMORY_MULTI_NONE;
+    
+    DEBUG_PRINT("Bank slot %u loaded: UID=%08X\r\n", slot, target->store.data[0]);
+    return true;
+}
+
+/*
+ * Make a slot the active token
+ * 
+ * Swaps the page and key schedule pointers. The session of the previous
+ * token ends and its cached responses are dropped (the cache is tagged
+ * by UID only, and two slots may share a UID).
+ * returns: false if slot is out of range
+ */
+bool memory_bank_select(uint16_t slot) {
+    if (slot >= MEMORY_BANK_SLOTS) {
+        return false;
+    }
+    
+    memory_auth_stop();
+    g_active = &g_bank[slot];
+    g_pages = g_active->store.data;
+    crypto_cache_invalidate();
+    memory_touch(MEMORY_ALL_PAGES);
+    
+    return true;
+}
+
+/*
+ * Check whether a slot holds a token
+ */
+bool memory_bank_used(uint16_t slot) {
+    return slot < MEMORY_BANK_SLOTS && g_bank[slot].used;
+}
+
+/*
+ * Get the UID of a slot
+ * returns: 0 if slot is out of range
+ */
+uint32_t memory_bank_uid(uint16_t slot) {
+    if (slot >= MEMORY_BANK_SLOTS) {
+        return 0;
+    }
+    return g_bank[slot].store.data[0];
+}
+
+/*
+ * Copy the token image of a slot (NUM_PAGES * 4 bytes)
+ * returns: false if slot is out of range or holds no token
+ */
+bool memory_bank_image(uint16_t slot, uint8_t* buffer) {
+    if (!memory_bank_used(slot)) {
+        return false;
+    }
+    memory_image_save(g_bank[slot].store.data, buffer);
+    return true;
+}
+
+/*
+ * Answer one challenge for count bank slots from first on
+ * 
+ * The bank is split into windows of CRYPTO_MULTI_MAX slots, and a
+ * window answers in one bitsliced pass (crypto_multi_response())
+ * instead of a response per token. The last window used stays
+ * transposed and is reused for every challenge until a slot is loaded
+ * or a key or UID changes.
+ * responses: one per slot, in slot order (slots that hold no token
+ * answer too; see memory_bank_used())
+ * returns: number of responses (fewer than count at the end of the bank)
+ */
+uint16_t memory_bank_auth(uint16_t first, uint16_t count, uint32_t challenge,
+                          uint32_t* responses) {
+    uint32_t window[CRYPTO_MULTI_MAX];
+    uint16_t done = 0;
+    
+    while (done < count && first + done < MEMORY_BANK_SLOTS) {
+        uint16_t slot = first + done;
+        uint16_t base = slot - slot % CRYPTO_MULTI_MAX;
+        uint16_t lanes = MEMORY_BANK_SLOTS - base;
+        if (lanes > CRYPTO_MULTI_MAX) {
+            lanes = CRYPTO_MULTI_MAX;
+        }
+        
+        if (g_multi_first != base) {
+            hitag2_key_t keys[CRYPTO_MULTI_MAX];
+            uint32_t uids[CRYPTO_MULTI_MAX];
+            
+            for (uint16_t i = 0; i < lanes; i++) {
+                const uint32_t* pages = g_bank[base + i].store.data;
+                memory_pages_key(pages, keys[i].bytes);
+                uids[i] = pages[0];
+            }
+            crypto_multi_init(&g_multi, keys, uids, lanes);
+            g_multi_first = base;
+        }
+        
+        crypto_multi_response(&g_multi, challenge, window);
+        for (uint16_t i = slot - base; i < lanes && done < count; i++) {
+            responses[done++] = window[i];
+        }
+    }
+    
+    return done;
+}
+
+/*
+ * Reload the bank from the flash token store
+ * 
+ * Every slot with a stored image is loaded (the store is keyed by slot
+ * number); the rest keep what they hold. Call after token_store_init().
+ * returns: number of slots loaded
+ */
+uint16_t memory_bank_restore(void) {
+    uint8_t image[TOKEN_STORE_IMAGE_SIZE];
+    uint16_t count = 0;
+    
+    for (uint16_t slot = 0; slot < MEMORY_BANK_SLOTS; slot++) {
+        if (token_store_get(slot, image) && memory_bank_load(slot, image, sizeof(image))) {
+            count++;
+        }
+    }
+    
+    DEBUG_PRINT("Bank restored: %u slots from flash\r\n", count);
+    return count;
+}
+
 /*
  * Read a page (32 bits)
  * page: page number (0-7)
@@ -88,7 +387,7 @@ uint32_t memory_read_page(uint8_t page) {
         return 0;
     }
     
-    return g_pages[page].data;
+    return g_pages[page];
 }
 
 /*
@@ -103,20 +402,233 @@ bool memory_write_page(uint8_t page, uint32_t data) {
         return false;
     }
     
-    if (!g_pages[page].writable) {
+    if (!((g_active->store.writable >> page) & 1)) {
+        DEBUG_PRINT("ERROR: Page %d is read-only\r\n", page);
+        return false;
+    }
+    
+    g_pages[page] = data;
+    memory_touch(1U << page);
+    return true;
+}
+
+/*
+ * Count this boot in the token store
+ * Call once at boot, after token_store_init(). Without a working store
+ * the epoch stays 0.
+ * returns: the new epoch
+ */
+uint32_t memory_epoch_advance(void) {
+    uint8_t image[TOKEN_STORE_IMAGE_SIZE] = {0};
+    uint32_t epoch = 0;
+    
+    if (token_store_get(MEMORY_EPOCH_KEY, image)) {
+        epoch = ((uint32_t)image[0] << 0) | ((uint32_t)image[1] << 8) |
+                ((uint32_t)image[2] << 16) | ((uint32_t)image[3] << 24);
+    }
+    epoch++;
+    image[0] = (epoch >> 0) & 0xFF;
+    image[1] = (epoch >> 8) & 0xFF;
+    image[2] = (epoch >> 16) & 0xFF;
+    image[3] = (epoch >> 24) & 0xFF;
+    
+    if (token_store_put(MEMORY_EPOCH_KEY, image)) {
+        g_epoch = epoch;
+    }
+    DEBUG_PRINT("Boot epoch %lu\r\n", (unsigned long)g_epoch);
+    return g_epoch;
+}
+
+/*
+ * Boot epoch of the generation counter
+ */
+uint32_t memory_epoch(void) {
+    return g_epoch;
+}
+
+/*
+ * Current change generation
+ */
+uint32_t memory_generation(void) {
+    return g_generation;
+}
+
+/*
+ * Pages of the active token changed after a generation
+ * A generation ahead of the current one (the caller saw an earlier
+ * boot) gets every page; callers check memory_epoch() for the rest.
+ * returns: bit n set if page n changed
+ */
+uint8_t memory_changed_since(uint32_t generation) {
+    uint8_t mask = 0;
+    
+    if (generation > g_generation) {
+        return MEMORY_ALL_PAGES;
+    }
+    for (int i = 0; i < NUM_PAGES; i++) {
+        if (g_page_generation[i] > generation) {
+            mask |= 1U << i;
+        }
+    }
+    return mask;
+}
+
+/*
+ * Start a page transaction
+ * 
+ * Writes go to a shadow image and become visible together at
+ * memory_txn_commit(). Starting again drops an open transaction.
+ */
+void memory_txn_begin(void) {
+    g_txn_written = 0;
+    g_txn_slot = g_active;
+}
+
+/*
+ * Write a page in the open transaction
+ * Same checks as memory_write_page(); nothing is visible until commit.
+ * returns: false if no transaction is open or the write is refused
+ */
+bool memory_txn_write(uint8_t page, uint32_t data) {
+    if (!g_txn_slot || page >= NUM_PAGES) {
+        return false;
+    }
+    
+    if (!((g_txn_slot->store.writable >> page) & 1)) {
         DEBUG_PRINT("ERROR: Page %d is read-only\r\n", page);
         return false;
     }
     
-    g_pages[page].data = data;
+    g_txn_shadow[page] = data;
+    g_txn_written |= 1U << page;
+    return true;
+}
+
+/*
+ * Make every page written in the transaction visible at once
+ * 
+ * The shadow is completed from the live pages and readers are switched
+ * to it with one pointer store; the slot's own pages are then brought
+ * up to date behind them and the pointer switched back. Readers see the
+ * old image or the new one, never a mix. Only the main loop writes
+ * pages, so nothing lands in the slot while readers are on the shadow.
+ * returns: false if no transaction is open or another slot was selected
+ */
+bool memory_txn_commit(void) {
+    memory_slot_t* slot = g_txn_slot;
+    
+    g_txn_slot = NULL;
+    if (!slot || slot != g_active) {
+        return false;
+    }
+    
+    for (int i = 0; i < NUM_PAGES; i++) {
+        if (!((g_txn_written >> i) & 1)) {
+            g_txn_shadow[i] = slot->store.data[i];
+        }
+    }
+    
+    __sync_synchronize();
+    g_pages = g_txn_shadow;
+    __sync_synchronize();
+    
+    for (int i = 0; i < NUM_PAGES; i++) {
+        slot->store.data[i] = g_txn_shadow[i];
+    }
+    
+    __sync_synchronize();
+    g_pages = slot->store.data;
+    memory_touch(g_txn_written);
     return true;
 }
 
+/*
+ * Drop the open transaction
+ */
+void memory_txn_abort(void) {
+    g_txn_slot = NULL;
+}
+
+/*
+ * Begin a crypto-mode session (reader sent START_AUTH, challenge follows)
+ * 
+ * Call at the start of the challenge, then memory_auth_feed_bit() per
+ * decoded bit. The session keystream is keyed from the token's
+ * precomputed key schedule, so each bit costs one init round. The
+ * previous session stays usable until memory_auth_finish() replaces
+ * it: a frame that turns out not to carry a challenge ends nothing.
+ */
+void memory_auth_begin(void) {
+    crypto_begin_ctx(&g_auth_feed, &g_active->ctx);
+}
+
+/*
+ * Fold in the next received challenge bit
+ * returns: false if the whole challenge has already been fed
+ */
+bool memory_auth_feed_bit(uint8_t bit) {
+    return crypto_feed_bit(&g_auth_feed, bit);
+}
+
+/*
+ * Start the session after the last challenge bit
+ * 
+ * The first 32 keystream bits are the authentication response
+ * (repeated challenges come from the response cache); every page read
+ * or written afterwards is XORed with the next 32 bits.
+ * returns: authentication response
+ */
+uint32_t memory_auth_finish(void) {
+    g_auth_active = true;
+    return crypto_finish(&g_auth_feed, &g_auth_stream);
+}
+
+/*
+ * End the crypto-mode session
+ */
+void memory_auth_stop(void) {
+    g_auth_active = false;
+}
+
+/*
+ * Check whether a crypto-mode session is active
+ */
+bool memory_auth_active(void) {
+    return g_auth_active;
+}
+
+/*
+ * Read a page for transmission
+ * In crypto mode the data is encrypted with fresh keystream
+ * returns: page data as sent on air
+ */
+uint32_t memory_read_page_crypto(uint8_t page) {
+    uint32_t data = memory_read_page(page);
+    
+    if (g_auth_active) {
+        data ^= crypto_stream_next_word32(&g_auth_stream);
+    }
+    return data;
+}
+
+/*
+ * Write a page received on air
+ * In crypto mode the data is decrypted with fresh keystream (consumed
+ * even if the write is refused, as the reader has already sent it)
+ * returns: true if successful
+ */
+bool memory_write_page_crypto(uint8_t page, uint32_t data) {
+    if (g_auth_active) {
+        data ^= crypto_stream_next_word32(&g_auth_stream);
+    }
+    return memory_write_page(page, data);
+}
+
 /*
  * Get UID (Page 0)
  */
 uint32_t memory_get_uid(void) {
-    return g_pages[0].data;
+    return g_pages[0];
 }
 
 /*
@@ -124,40 +636,31 @@ uint32_t memory_get_uid(void) {
  * Note: In real tags this is read-only, but emulator allows setting
  */
 void memory_set_uid(uint32_t uid) {
-    g_pages[0].data = uid;
+    g_pages[0] = uid;
+    memory_key_changed();
+    memory_touch(1U << 0);
 }
 
 /*
  * Get configuration (Page 1)
  */
 uint32_t memory_get_config(void) {
-    return g_pages[1].data;
+    return g_pages[1];
 }
 
 /*
  * Set configuration (Page 1)
  */
 void memory_set_config(uint32_t config) {
-    g_pages[1].data = config;
+    g_pages[1] = config;
+    memory_touch(1U << 1);
 }
 
 /*
  * Get key (Pages 2-3)
  */
 void memory_get_key(uint8_t* key) {
-    // Page 2: Key bits 0-31
-    uint32_t key_low = g_pages[2].data;
-    
-    // Page 3: Key bits 32-47 (upper 16 bits) + Password (lower 16 bits)
-    uint32_t key_high = g_pages[3].data;
-    
-    // Extract key from page 3 (upper 16 bits)
-    key[0] = (key_low >> 0) & 0xFF;
-    key[1] = (key_low >> 8) & 0xFF;
-    key[2] = (key_low >> 16) & 0xFF;
-    key[3] = (key_low >> 24) & 0xFF;
-    key[4] = (key_high >> 16) & 0xFF;  // Bits 32-39
-    key[5] = (key_high >> 24) & 0xFF;  // Bits 40-47
+    memory_pages_key(g_pages, key);
 }
 
 /*
@@ -165,17 +668,20 @@ void memory_get_key(uint8_t* key) {
  */
 void memory_set_key(const uint8_t* key) {
     // Page 2: Key bits 0-31
-    g_pages[2].data = ((uint32_t)key[0] << 0) |
-                      ((uint32_t)key[1] << 8) |
-                      ((uint32_t)key[2] << 16) |
-                      ((uint32_t)key[3] << 24);
+    g_pages[2] = ((uint32_t)key[0] << 0) |
+                 ((uint32_t)key[1] << 8) |
+                 ((uint32_t)key[2] << 16) |
+                 ((uint32_t)key[3] << 24);
     
     // Page 3: Key bits 32-47 (upper 16 bits) + Password (lower 16 bits)
     // Keep password (lower 16 bits) if it exists
-    uint16_t password = g_pages[3].data & 0xFFFF;
-    g_pages[3].data = password |
-                      ((uint32_t)key[4] << 16) |
-                      ((uint32_t)key[5] << 24);
+    uint16_t password = g_pages[3] & 0xFFFF;
+    g_pages[3] = password |
+                 ((uint32_t)key[4] << 16) |
+                 ((uint32_t)key[5] << 24);
+    
+    memory_key_changed();
+    memory_touch((1U << 2) | (1U << 3));
 }
 
 /*
@@ -185,7 +691,7 @@ uint32_t memory_get_user_page(uint8_t page) {
     if (page < 4 || page >= NUM_PAGES) {
         return 0;
     }
-    return g_pages[page].data;
+    return g_pages[page];
 }
 
 /*
@@ -195,7 +701,8 @@ void memory_set_user_page(uint8_t page, uint32_t data) {
     if (page < 4 || page >= NUM_PAGES) {
         return;
     }
-    g_pages[page].data = data;
+    g_pages[page] = data;
+    memory_touch(1U << page);
 }
 
 /*
@@ -205,7 +712,7 @@ bool memory_is_page_writable(uint8_t page) {
     if (page >= NUM_PAGES) {
         return false;
     }
-    return g_pages[page].writable;
+    return (g_active->store.writable >> page) & 1;
 }
 
 /*
@@ -213,7 +720,7 @@ bool memory_is_page_writable(uint8_t page) {
  */
 bool memory_is_locked(void) {
     // Check bit 1 of page 1 configuration
-    return (g_pages[1].data >> 2) & 1;
+    return (g_pages[1] >> 2) & 1;
 }
 
 /*
@@ -221,7 +728,7 @@ bool memory_is_locked(void) {
  */
 bool memory_auth_required(void) {
     // Check bit 0 of page 1 configuration
-    return (g_pages[1].data >> 1) & 1;
+    return (g_pages[1] >> 1) & 1;
 }
 
 /*
@@ -229,8 +736,12 @@ bool memory_auth_required(void) {
  */
 void memory_clear(void) {
     for (int i = 0; i < NUM_PAGES; i++) {
-        g_pages[i].data = 0;
+        g_pages[i] = 0;
     }
+    g_active->used = false;
+    
+    memory_key_changed();
+    memory_touch(MEMORY_ALL_PAGES);
 }
 
 /*
@@ -239,38 +750,46 @@ void memory_clear(void) {
 void memory_load_paxton_demo(void) {
     // Example Paxton NET2 token data
     // Page 0: UID
-    g_pages[0].data = 0x12345678;
+    g_pages[0] = 0x12345678;
     
     // Page 1: Configuration
-    g_pages[1].data = 0x00000000;
+    g_pages[1] = 0x00000000;
     
     // Page 2-3: Authentication key
-    g_pages[2].data = 0xA5A5A5A5;  // Key bits 0-31
-    g_pages[3].data = 0x5A5A0000;  // Key bits 32-47 + password
+    g_pages[2] = 0xA5A5A5A5;  // Key bits 0-31
+    g_pages[3] = 0x5A5A0000;  // Key bits 32-47 + password
     
     // Page 4-7: User data (Paxton NET2 format)
-    g_pages[4].data = 0x00000001;  // Site code
-    g_pages[5].data = 0x00001234;  // User ID
-    g_pages[6].data = 0x00000000;  // Additional data
-    g_pages[7].data = 0x00000000;  // Reserved
+    g_pages[4] = 0x00000001;  // Site code
+    g_pages[5] = 0x00001234;  // User ID
+    g_pages[6] = 0x00000000;  // Additional data
+    g_pages[7] = 0x00000000;  // Reserved
+    g_active->used = true;
+    
+    memory_key_changed();
+    memory_touch(MEMORY_ALL_PAGES);
     
-    DEBUG_PRINT("Paxton demo token loaded: UID=%08X\r\n", g_pages[0].data);
+    DEBUG_PRINT("Paxton demo token loaded: UID=%08X\r\n", g_pages[0]);
 }
 
 /*
  * Load a default test token
  */
 void memory_load_default_token(void) {
-    g_pages[0].data = 0xDEADBEEF;
-    g_pages[1].data = 0x00000000;
-    g_pages[2].data = 0x12345678;
-    g_pages[3].data = 0x9ABC0000;
-    g_pages[4].data = 0x00000000;
-    g_pages[5].data = 0x00000000;
-    g_pages[6].data = 0x00000000;
-    g_pages[7].data = 0x00000000;
+    g_pages[0] = 0xDEADBEEF;
+    g_pages[1] = 0x00000000;
+    g_pages[2] = 0x12345678;
+    g_pages[3] = 0x9ABC0000;
+    g_pages[4] = 0x00000000;
+    g_pages[5] = 0x00000000;
+    g_pages[6] = 0x00000000;
+    g_pages[7] = 0x00000000;
+    g_active->used = true;
+    
+    memory_key_changed();
+    memory_touch(MEMORY_ALL_PAGES);
     
-    DEBUG_PRINT("Default token loaded: UID=%08X\r\n", g_pages[0].data);
+    DEBUG_PRINT("Default token loaded: UID=%08X\r\n", g_pages[0]);
 }
 
 /*
@@ -280,8 +799,8 @@ void memory_dump(void) {
     DEBUG_PRINT("=== Memory Dump ===\r\n");
     for (int i = 0; i < NUM_PAGES; i++) {
         DEBUG_PRINT("Page %d: %08X %s\r\n", 
-            i, g_pages[i].data, 
-            g_pages[i].writable ? "(R/W)" : "(R/O)");
+            i, g_pages[i], 
+            ((g_active->store.writable >> i) & 1) ? "(R/W)" : "(R/O)");
     }
     DEBUG_PRINT("==================\r\n");
 }
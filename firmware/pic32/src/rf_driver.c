@@ -6,6 +6,8 @@
 
 #include "rf_driver.h"
 #include "main.h"
+#include "clock.h"
+#include "memory.h"
 #include "debug.h"
 
 // RF configuration constants
@@ -17,14 +19,37 @@
 #define RESPONSE_DELAY_US     256UL      // Response delay (256 µs)
 
 // PWM configuration
-#define PWM_TIMER_FREQ_HZ     80000000UL // 80 MHz system clock
+#define PWM_TIMER_FREQ_HZ     SYSCLK_HZ  // Timer clocked from SYSCLK, 1:1
 #define PWM_PERIOD            (PWM_TIMER_FREQ_HZ / (CARRIER_FREQ_HZ * 2) - 1)  // 319
 #define PWM_DUTY_50           (PWM_PERIOD / 2)  // 50% duty cycle
 
+// Reader commands (first bit on air in bit 0)
+// START_AUTH carries the 32-bit challenge in the same frame
+#define RF_CMD_START_AUTH       0x03  // 1 1 0 0 0
+#define RF_CMD_START_AUTH_BITS  5
+#define RF_CHALLENGE_BITS       32
+
+// Page commands: 2-bit opcode, 3-bit page, then those 5 bits inverted
+#define RF_CMD_PAGE_BITS        10
+#define RF_CMD_HALT             0x0   // 0 0
+#define RF_CMD_WRITE_PAGE       0x1   // 1 0
+#define RF_CMD_READ_PAGE_INV    0x2   // 0 1
+#define RF_CMD_READ_PAGE        0x3   // 1 1
+
+// Longest reader frame and how long to wait for one
+#define RF_FRAME_MAX_BITS       (RF_CMD_START_AUTH_BITS + RF_CHALLENGE_BITS)
+#define RF_FRAME_BYTES          ((RF_FRAME_MAX_BITS + 7) / 8)
+#define RF_FRAME_TIMEOUT_MS     20
+
 // RF state
 static volatile rf_state_t g_rf_state = RF_STATE_IDLE;
 static volatile bool g_field_detected = false;
 
+// Reader frame being received: its first bits, and whether they were
+// START_AUTH so the rest is challenge going straight into the cipher
+static uint8_t g_rf_frame_head = 0;
+static bool g_rf_frame_auth = false;
+
 // Timing variables
 static volatile uint32_t g_rf_timer_start = 0;
 static volatile uint16_t g_rf_bit_buffer = 0;
@@ -347,6 +372,15 @@ uint16_t rf_receive_manchester(uint8_t* buffer, uint16_t max_bits, uint32_t time
  * Simplified Manchester receive (polling-based)
  */
 uint16_t rf_receive_simple(uint8_t* buffer, uint16_t max_bits, uint32_t timeout_ms) {
+    return rf_receive_bits(buffer, max_bits, timeout_ms, NULL);
+}
+
+/*
+ * Simplified Manchester receive, handing each bit to on_bit (may be
+ * NULL) as it is decoded, while the next one is still on air
+ */
+uint16_t rf_receive_bits(uint8_t* buffer, uint16_t max_bits, uint32_t timeout_ms,
+                         rf_bit_handler_t on_bit) {
     uint16_t bit_count = 0;
     uint32_t start_time = system_get_ticks();
     uint8_t last_sample = 0;
@@ -401,6 +435,9 @@ uint16_t rf_receive_simple(uint8_t* buffer, uint16_t max_bits, uint32_t timeout_
         if (bit) {
             buffer[bit_count / 8] |= (1 << (bit_count % 8));
         }
+        if (on_bit) {
+            on_bit(bit, bit_count);
+        }
         bit_count++;
         
         // Check for next gap (end of transmission)
@@ -458,6 +495,130 @@ bool rf_get_field_detected(void) {
     return g_field_detected;
 }
 
+/*
+ * Extract count (up to 32) received bits starting at bit first
+ */
+static uint32_t rf_frame_bits(const uint8_t* frame, uint16_t first, uint8_t count) {
+    uint32_t value = 0;
+    
+    for (uint8_t i = 0; i < count; i++) {
+        uint16_t n = first + i;
+        value |= (uint32_t)((frame[n / 8] >> (n % 8)) & 1) << i;
+    }
+    return value;
+}
+
+/*
+ * Store a word for transmission (bit 0 first)
+ */
+static void rf_put_word(uint8_t* out, uint32_t word) {
+    out[0] = (word >> 0) & 0xFF;
+    out[1] = (word >> 8) & 0xFF;
+    out[2] = (word >> 16) & 0xFF;
+    out[3] = (word >> 24) & 0xFF;
+}
+
+/*
+ * Bit handler for reader frames
+ * Once the first bits read START_AUTH, every following bit is a
+ * challenge bit and runs its init round while the next one arrives,
+ * so only the keystream is left when the frame ends.
+ */
+static void rf_frame_bit(uint8_t bit, uint16_t index) {
+    if (index < RF_CMD_START_AUTH_BITS) {
+        g_rf_frame_head |= bit << index;
+        if (index == RF_CMD_START_AUTH_BITS - 1 && g_rf_frame_head == RF_CMD_START_AUTH) {
+            memory_auth_begin();
+            g_rf_frame_auth = true;
+        }
+    } else if (g_rf_frame_auth) {
+        memory_auth_feed_bit(bit);
+    }
+}
+
+/*
+ * Answer the reader after the response delay
+ */
+static void rf_reply(const uint8_t* data, uint16_t num_bits) {
+    rf_set_state(RF_STATE_TRANSMITTING);
+    rf_send_response_delay(rf_get_response_delay_us());
+    rf_send_bpsk(data, num_bits);
+    rf_set_state(RF_STATE_LISTENING);
+}
+
+/*
+ * Receive and answer one reader command
+ * 
+ * START_AUTH + challenge is answered with UID and response and starts
+ * the crypto-mode session (the challenge is fed to the cipher during
+ * reception); from then on page data crosses the air
+ * encrypted with the session keystream. Without a session, a token
+ * that requires authentication only gives out its UID. HALT ends the
+ * session and silences the tag until the field drops.
+ */
+static void rf_handle_command(void) {
+    uint8_t frame[RF_FRAME_BYTES];
+    uint8_t reply[8];
+    
+    g_rf_frame_head = 0;
+    g_rf_frame_auth = false;
+    uint16_t bits = rf_receive_bits(frame, RF_FRAME_MAX_BITS, RF_FRAME_TIMEOUT_MS, rf_frame_bit);
+    
+    if (bits == RF_FRAME_MAX_BITS && g_rf_frame_auth) {
+        rf_set_state(RF_STATE_PROCESSING);
+        uint32_t response = memory_auth_finish();
+        
+        rf_put_word(&reply[0], memory_get_uid());
+        rf_put_word(&reply[4], response);
+        rf_reply(reply, 64);
+        return;
+    }
+    
+    if (bits != RF_CMD_PAGE_BITS) {
+        return;  // Nothing received, or not a command we know
+    }
+    
+    uint32_t cmd = rf_frame_bits(frame, 0, RF_CMD_PAGE_BITS);
+    uint8_t op = cmd & 0x3;
+    uint8_t page = (cmd >> 2) & 0x7;
+    
+    if ((((cmd >> 5) ^ cmd) & 0x1F) != 0x1F) {
+        return;  // Check bits do not match
+    }
+    if (op != RF_CMD_HALT && page != 0 && memory_auth_required() && !memory_auth_active()) {
+        return;  // Authenticate first
+    }
+    
+    rf_set_state(RF_STATE_PROCESSING);
+    switch (op) {
+        case RF_CMD_READ_PAGE:
+        case RF_CMD_READ_PAGE_INV:
+            {
+                uint32_t data = memory_read_page_crypto(page);
+                rf_put_word(reply, (op == RF_CMD_READ_PAGE) ? data : ~data);
+                rf_reply(reply, 32);
+            }
+            break;
+            
+        case RF_CMD_WRITE_PAGE:
+            // Acknowledge by echoing the command, then take the data;
+            // echo it again once the page is written
+            rf_put_word(reply, cmd);
+            rf_reply(reply, RF_CMD_PAGE_BITS);
+            bits = rf_receive_simple(frame, 32, RF_FRAME_TIMEOUT_MS);
+            if (bits == 32 && memory_write_page_crypto(page, rf_frame_bits(frame, 0, 32))) {
+                rf_reply(reply, RF_CMD_PAGE_BITS);
+            }
+            break;
+            
+        case RF_CMD_HALT:
+            memory_auth_stop();
+            rf_set_state(RF_STATE_HALT);
+            return;
+    }
+    rf_set_state(RF_STATE_LISTENING);
+}
+
 /*
  * Process RF events (call from main loop)
  */
@@ -470,8 +631,13 @@ void rf_driver_process(void) {
             break;
             
         case RF_STATE_LISTENING:
-            // Check for incoming command
-            // This would be handled by the command parser
+            // Field gone: the reader has to authenticate again
+            if (!g_field_detected) {
+                memory_auth_stop();
+                rf_set_state(RF_STATE_IDLE);
+            } else if (g_app_state.mode == MODE_EMULATION && g_app_state.token_loaded) {
+                rf_handle_command();
+            }
             break;
             
         case RF_STATE_PROCESSING:
@@ -492,7 +658,10 @@ void rf_driver_process(void) {
             break;
             
         case RF_STATE_HALT:
-            // Halt mode - no response
+            // Halt mode - no response until the field drops
+            if (!g_field_detected) {
+                rf_set_state(RF_STATE_IDLE);
+            }
             break;
     }
 }
@@ -512,6 +681,13 @@ void rf_send_start_gap(uint16_t gap_us) {
     system_delay_us(gap_us);
 }
 
+/*
+ * Get the response delay the reply (including its crypto) has to fit in
+ */
+uint16_t rf_get_response_delay_us(void) {
+    return RESPONSE_DELAY_US;
+}
+
 /*
  * Send response delay
  */
@@ -12,6 +12,7 @@
 #include "spi_slave.h"
 #include "main.h"
 #include "memory.h"
+#include "token_store.h"
 #include "crypto.h"
 #include "rf_driver.h"
 #include "debug.h"
@@ -22,6 +23,7 @@
 #define CMD_RESET         0x02
 #define CMD_READ_PAGE     0x10
 #define CMD_WRITE_PAGE    0x20
+#define CMD_WRITE_PAGES   0x21
 #define CMD_SET_KEY       0x30
 #define CMD_GET_KEY       0x31
 #define CMD_SET_UID       0x40
@@ -30,9 +32,19 @@
 #define CMD_GET_CONFIG    0x51
 #define CMD_LOAD_TOKEN    0x60
 #define CMD_SAVE_TOKEN    0x61
+#define CMD_BANK_LOAD     0x62
+#define CMD_BANK_SELECT   0x63
+#define CMD_BANK_LIST     0x64
+#define CMD_STORE_SAVE    0x65
+#define CMD_STORE_DROP    0x66
+#define CMD_STORE_INFO    0x67
+#define CMD_SAVE_TOKEN_DELTA 0x68
+#define CMD_BANK_AUTH     0x69
 #define CMD_START_EMULATE 0x70
 #define CMD_STOP_EMULATE  0x71
 #define CMD_GET_STATUS    0x80
+#define CMD_GET_CRYPTO    0x81
+#define CMD_GET_PROFILE   0x82
 #define CMD_DEBUG_MODE    0xA0
 
 // Status codes
@@ -41,6 +53,24 @@
 #define STATUS_BUSY       0x02
 #define STATUS_RDY        0x03
 
+// CMD_GET_CRYPTO: backend index meaning "the active backend"
+#define CRYPTO_BACKEND_ACTIVE  0xFF
+
+// CMD_GET_CRYPTO: length of the NUL-padded backend name field
+#define CRYPTO_NAME_LEN        16
+
+// CMD_GET_PROFILE: slot meaning "the RF authentication path"
+#define CRYPTO_PROFILE_AUTH_SLOT  0xFF
+
+// CMD_GET_PROFILE: byte 2 flag, clear every slot after reading
+#define CRYPTO_PROFILE_FLAG_RESET 0x01
+
+// CMD_BANK_LIST: UIDs per reply
+#define BANK_LIST_MAX     12
+
+// CMD_BANK_AUTH: responses per reply
+#define BANK_AUTH_MAX     12
+
 // SPI buffer sizes
 #define SPI_RX_BUFFER_SIZE  64
 #define SPI_TX_BUFFER_SIZE  64
@@ -151,9 +181,10 @@ static void spi_process_command(void) {
             // Reset PIC32 state
             memory_init();
             crypto_init();
+            memory_bank_restore();
             rf_set_state(RF_STATE_IDLE);
             g_app_state.mode = MODE_IDLE;
-            g_app_state.token_loaded = false;
+            g_app_state.token_loaded = memory_bank_used(memory_bank_active());
             g_spi_tx_buffer[0] = STATUS_OK;
             spi_set_tx_length(1);
             DEBUG_PRINT("SPI: RESET received\r\n");
@@ -196,6 +227,33 @@ static void spi_process_command(void) {
             }
             break;
             
+        case CMD_WRITE_PAGES:
+            {
+                // Byte 1: count, then count × (page, data LE); all pages
+                // change together or none do
+                uint8_t count = g_spi_rx_buffer[1];
+                bool ok = (count > 0 && count <= NUM_PAGES && len >= 2 + 5 * count);
+                
+                memory_txn_begin();
+                for (uint8_t i = 0; ok && i < count; i++) {
+                    const uint8_t* in = &g_spi_rx_buffer[2 + 5 * i];
+                    uint32_t data = ((uint32_t)in[1] << 0) |
+                                    ((uint32_t)in[2] << 8) |
+                                    ((uint32_t)in[3] << 16) |
+                                    ((uint32_t)in[4] << 24);
+                    ok = memory_txn_write(in[0], data);
+                }
+                if (ok) {
+                    ok = memory_txn_commit();
+                } else {
+                    memory_txn_abort();
+                }
+                g_spi_tx_buffer[0] = ok ? STATUS_OK : STATUS_ERR;
+                spi_set_tx_length(1);
+                DEBUG_PRINT("SPI: WRITE_PAGES count=%d %s\r\n", count, ok ? "ok" : "refused");
+            }
+            break;
+            
         case CMD_SET_KEY:
             if (len >= 7) {
                 uint8_t key[6];
@@ -292,14 +350,229 @@ static void spi_process_command(void) {
             
         case CMD_SAVE_TOKEN:
             {
+                // Reply: status, length, then the token image
                 uint16_t token_len = 0;
-                memory_save_token(&g_spi_tx_buffer[1], &token_len);
+                memory_save_token(&g_spi_tx_buffer[2], &token_len);
                 g_spi_tx_buffer[0] = STATUS_OK;
                 g_spi_tx_buffer[1] = token_len;
                 spi_set_tx_length(2 + token_len);
             }
             break;
             
+        case CMD_SAVE_TOKEN_DELTA:
+            {
+                // Framed as the bridge sends it: byte 1 is the data length
+                // (4), bytes 2-5 the generation the master last saw
+                // (0: everything). Reply: status, length, boot epoch,
+                // current generation, page mask, then the changed pages in
+                // page order. The master resyncs from 0 when the epoch is
+                // not the one its generation came from.
+                if (len < 6 || g_spi_rx_buffer[1] != 4) {
+                    g_spi_tx_buffer[0] = STATUS_ERR;
+                    spi_set_tx_length(1);
+                    break;
+                }
+                
+                uint32_t since = ((uint32_t)g_spi_rx_buffer[2] << 0) |
+                                 ((uint32_t)g_spi_rx_buffer[3] << 8) |
+                                 ((uint32_t)g_spi_rx_buffer[4] << 16) |
+                                 ((uint32_t)g_spi_rx_buffer[5] << 24);
+                
+                uint32_t epoch = memory_epoch();
+                uint32_t generation = memory_generation();
+                uint8_t mask = memory_changed_since(since);
+                uint8_t pos = 11;
+                
+                for (uint8_t page = 0; page < NUM_PAGES; page++) {
+                    if ((mask >> page) & 1) {
+                        uint32_t data = memory_read_page(page);
+                        g_spi_tx_buffer[pos++] = (data >> 0) & 0xFF;
+                        g_spi_tx_buffer[pos++] = (data >> 8) & 0xFF;
+                        g_spi_tx_buffer[pos++] = (data >> 16) & 0xFF;
+                        g_spi_tx_buffer[pos++] = (data >> 24) & 0xFF;
+                    }
+                }
+                
+                g_spi_tx_buffer[0] = STATUS_OK;
+                g_spi_tx_buffer[1] = pos - 2;
+                g_spi_tx_buffer[2] = (epoch >> 0) & 0xFF;
+                g_spi_tx_buffer[3] = (epoch >> 8) & 0xFF;
+                g_spi_tx_buffer[4] = (epoch >> 16) & 0xFF;
+                g_spi_tx_buffer[5] = (epoch >> 24) & 0xFF;
+                g_spi_tx_buffer[6] = (generation >> 0) & 0xFF;
+                g_spi_tx_buffer[7] = (generation >> 8) & 0xFF;
+                g_spi_tx_buffer[8] = (generation >> 16) & 0xFF;
+                g_spi_tx_buffer[9] = (generation >> 24) & 0xFF;
+                g_spi_tx_buffer[10] = mask;
+                spi_set_tx_length(pos);
+            }
+            break;
+            
+        case CMD_BANK_LOAD:
+            {
+                // Bytes 1-2: slot (little-endian), bytes 3-34: token image
+                uint16_t slot = g_spi_rx_buffer[1] | ((uint16_t)g_spi_rx_buffer[2] << 8);
+                if (len >= 35 && memory_bank_load(slot, &g_spi_rx_buffer[3], len - 3)) {
+                    g_spi_tx_buffer[0] = STATUS_OK;
+                    if (slot == memory_bank_active()) {
+                        g_app_state.token_loaded = true;
+                    }
+                    DEBUG_PRINT("SPI: BANK_LOAD slot %u\r\n", slot);
+                } else {
+                    g_spi_tx_buffer[0] = STATUS_ERR;
+                }
+                spi_set_tx_length(1);
+            }
+            break;
+            
+        case CMD_BANK_SELECT:
+            {
+                // Bytes 1-2: slot (little-endian)
+                uint16_t slot = g_spi_rx_buffer[1] | ((uint16_t)g_spi_rx_buffer[2] << 8);
+                if (len >= 3 && memory_bank_select(slot)) {
+                    uint32_t uid = memory_get_uid();
+                    g_app_state.token_loaded = memory_bank_used(slot);
+                    g_spi_tx_buffer[0] = STATUS_OK;
+                    g_spi_tx_buffer[1] = g_app_state.token_loaded ? 1 : 0;
+                    g_spi_tx_buffer[2] = (uid >> 0) & 0xFF;
+                    g_spi_tx_buffer[3] = (uid >> 8) & 0xFF;
+                    g_spi_tx_buffer[4] = (uid >> 16) & 0xFF;
+                    g_spi_tx_buffer[5] = (uid >> 24) & 0xFF;
+                    spi_set_tx_length(6);
+                    DEBUG_PRINT("SPI: BANK_SELECT slot %u UID=%08X\r\n", slot, uid);
+                } else {
+                    g_spi_tx_buffer[0] = STATUS_ERR;
+                    spi_set_tx_length(1);
+                }
+            }
+            break;
+            
+        case CMD_BANK_LIST:
+            {
+                // Bytes 1-2: first slot; reply lists up to BANK_LIST_MAX
+                // UIDs from there, with a bit per slot that is loaded
+                uint16_t first = g_spi_rx_buffer[1] | ((uint16_t)g_spi_rx_buffer[2] << 8);
+                uint16_t slots = memory_bank_slots();
+                uint16_t active = memory_bank_active();
+                uint8_t count = 0;
+                uint16_t used = 0;
+                
+                if (first < slots) {
+                    count = (slots - first < BANK_LIST_MAX) ? slots - first : BANK_LIST_MAX;
+                }
+                
+                g_spi_tx_buffer[0] = STATUS_OK;
+                g_spi_tx_buffer[1] = slots & 0xFF;
+                g_spi_tx_buffer[2] = slots >> 8;
+                g_spi_tx_buffer[3] = active & 0xFF;
+                g_spi_tx_buffer[4] = active >> 8;
+                g_spi_tx_buffer[5] = count;
+                for (uint8_t i = 0; i < count; i++) {
+                    uint32_t uid = memory_bank_uid(first + i);
+                    uint8_t* out = &g_spi_tx_buffer[8 + 4 * i];
+                    
+                    if (memory_bank_used(first + i)) {
+                        used |= 1U << i;
+                    }
+                    out[0] = (uid >> 0) & 0xFF;
+                    out[1] = (uid >> 8) & 0xFF;
+                    out[2] = (uid >> 16) & 0xFF;
+                    out[3] = (uid >> 24) & 0xFF;
+                }
+                g_spi_tx_buffer[6] = used & 0xFF;
+                g_spi_tx_buffer[7] = used >> 8;
+                spi_set_tx_length(8 + 4 * count);
+            }
+            break;
+            
+        case CMD_BANK_AUTH:
+            {
+                // Framed as the bridge sends it: byte 1 is the data length
+                // (6), bytes 2-3 the first slot, bytes 4-7 the challenge
+                // (little-endian). Reply: status, length, count, a bit per
+                // slot that is loaded, then each slot's response.
+                if (len < 8 || g_spi_rx_buffer[1] != 6) {
+                    g_spi_tx_buffer[0] = STATUS_ERR;
+                    spi_set_tx_length(1);
+                    break;
+                }
+                
+                uint16_t first = g_spi_rx_buffer[2] | ((uint16_t)g_spi_rx_buffer[3] << 8);
+                uint32_t challenge = ((uint32_t)g_spi_rx_buffer[4] << 0) |
+                                     ((uint32_t)g_spi_rx_buffer[5] << 8) |
+                                     ((uint32_t)g_spi_rx_buffer[6] << 16) |
+                                     ((uint32_t)g_spi_rx_buffer[7] << 24);
+                uint32_t responses[BANK_AUTH_MAX];
+                uint8_t count = memory_bank_auth(first, BANK_AUTH_MAX, challenge, responses);
+                uint16_t used = 0;
+                
+                for (uint8_t i = 0; i < count; i++) {
+                    uint8_t* out = &g_spi_tx_buffer[5 + 4 * i];
+                    
+                    if (memory_bank_used(first + i)) {
+                        used |= 1U << i;
+                    }
+                    out[0] = (responses[i] >> 0) & 0xFF;
+                    out[1] = (responses[i] >> 8) & 0xFF;
+                    out[2] = (responses[i] >> 16) & 0xFF;
+                    out[3] = (responses[i] >> 24) & 0xFF;
+                }
+                
+                g_spi_tx_buffer[0] = STATUS_OK;
+                g_spi_tx_buffer[1] = 3 + 4 * count;
+                g_spi_tx_buffer[2] = count;
+                g_spi_tx_buffer[3] = used & 0xFF;
+                g_spi_tx_buffer[4] = used >> 8;
+                spi_set_tx_length(5 + 4 * count);
+            }
+            break;
+            
+        case CMD_STORE_SAVE:
+        case CMD_STORE_DROP:
+            {
+                // Bytes 1-2: slot (little-endian). Flash stalls the CPU for
+                // up to a page erase, so not while emulating.
+                uint16_t slot = g_spi_rx_buffer[1] | ((uint16_t)g_spi_rx_buffer[2] << 8);
+                uint8_t image[TOKEN_STORE_IMAGE_SIZE];
+                
+                if (g_app_state.mode == MODE_EMULATION) {
+                    g_spi_tx_buffer[0] = STATUS_BUSY;
+                } else if (len < 3) {
+                    g_spi_tx_buffer[0] = STATUS_ERR;
+                } else if (cmd == CMD_STORE_SAVE) {
+                    bool ok = memory_bank_image(slot, image) && token_store_put(slot, image);
+                    g_spi_tx_buffer[0] = ok ? STATUS_OK : STATUS_ERR;
+                } else {
+                    bool ok = slot < memory_bank_slots() && token_store_delete(slot);
+                    g_spi_tx_buffer[0] = ok ? STATUS_OK : STATUS_ERR;
+                }
+                spi_set_tx_length(1);
+                DEBUG_PRINT("SPI: STORE_%s slot %u\r\n", (cmd == CMD_STORE_SAVE) ? "SAVE" : "DROP", slot);
+            }
+            break;
+            
+        case CMD_STORE_INFO:
+            {
+                token_store_stats_t stats;
+                token_store_stats(&stats);
+                
+                g_spi_tx_buffer[0] = STATUS_OK;
+                g_spi_tx_buffer[1] = stats.keys & 0xFF;
+                g_spi_tx_buffer[2] = stats.keys >> 8;
+                g_spi_tx_buffer[3] = stats.pages;
+                g_spi_tx_buffer[4] = stats.free_pages;
+                g_spi_tx_buffer[5] = (stats.min_erase >> 0) & 0xFF;
+                g_spi_tx_buffer[6] = (stats.min_erase >> 8) & 0xFF;
+                g_spi_tx_buffer[7] = (stats.min_erase >> 16) & 0xFF;
+                g_spi_tx_buffer[8] = (stats.min_erase >> 24) & 0xFF;
+                g_spi_tx_buffer[9] = (stats.max_erase >> 0) & 0xFF;
+                g_spi_tx_buffer[10] = (stats.max_erase >> 8) & 0xFF;
+                g_spi_tx_buffer[11] = (stats.max_erase >> 16) & 0xFF;
+                g_spi_tx_buffer[12] = (stats.max_erase >> 24) & 0xFF;
+                spi_set_tx_length(13);
+            }
+            break;
+            
         case CMD_START_EMULATE:
             g_app_state.mode = MODE_EMULATION;
             rf_set_state(RF_STATE_LISTENING);
@@ -328,6 +601,91 @@ static void spi_process_command(void) {
             spi_set_tx_length(8);
             break;
             
+        case CMD_GET_CRYPTO:
+            {
+                // Byte 1 selects a backend; 0xFF reports the active one
+                uint8_t index = g_spi_rx_buffer[1];
+                if (index == CRYPTO_BACKEND_ACTIVE) {
+                    index = crypto_backend_active();
+                }
+                
+                const crypto_backend_t* backend = crypto_backend_get(index);
+                const crypto_backend_stats_t* stats = crypto_backend_stats(index);
+                if (backend) {
+                    g_spi_tx_buffer[0] = STATUS_OK;
+                    g_spi_tx_buffer[1] = index;
+                    g_spi_tx_buffer[2] = crypto_backend_active();
+                    g_spi_tx_buffer[3] = crypto_backend_count();
+                    g_spi_tx_buffer[4] = backend->caps;
+                    g_spi_tx_buffer[5] = stats->correct ? 1 : 0;
+                    g_spi_tx_buffer[6] = (stats->ticks >> 0) & 0xFF;
+                    g_spi_tx_buffer[7] = (stats->ticks >> 8) & 0xFF;
+                    g_spi_tx_buffer[8] = (stats->ticks >> 16) & 0xFF;
+                    g_spi_tx_buffer[9] = (stats->ticks >> 24) & 0xFF;
+                    g_spi_tx_buffer[10] = crypto_ticks_per_us();
+                    strncpy((char*)&g_spi_tx_buffer[11], backend->name, CRYPTO_NAME_LEN - 1);
+                    spi_set_tx_length(11 + CRYPTO_NAME_LEN);
+                    DEBUG_PRINT("SPI: GET_CRYPTO %s\r\n", backend->name);
+                } else {
+                    g_spi_tx_buffer[0] = STATUS_ERR;
+                    spi_set_tx_length(1);
+                }
+            }
+            break;
+            
+        case CMD_GET_PROFILE:
+            {
+                // Byte 1 selects a slot (0xFF: auth path), byte 2 bit 0 resets
+                uint8_t slot = g_spi_rx_buffer[1];
+                if (slot == CRYPTO_PROFILE_AUTH_SLOT) {
+                    slot = crypto_profile_slot(CRYPTO_PROFILE_FINISH);
+                }
+                
+                crypto_profile_t profile;
+                if (crypto_profile_get(slot, &profile)) {
+                    uint32_t mean = profile.count ? (uint32_t)(profile.total / profile.count) : 0;
+                    uint16_t deadline = rf_get_response_delay_us();
+                    
+                    g_spi_tx_buffer[0] = STATUS_OK;
+                    g_spi_tx_buffer[1] = slot;
+                    g_spi_tx_buffer[2] = crypto_profile_count();
+                    g_spi_tx_buffer[3] = crypto_ticks_per_us();
+                    g_spi_tx_buffer[4] = (profile.count >> 0) & 0xFF;
+                    g_spi_tx_buffer[5] = (profile.count >> 8) & 0xFF;
+                    g_spi_tx_buffer[6] = (profile.count >> 16) & 0xFF;
+                    g_spi_tx_buffer[7] = (profile.count >> 24) & 0xFF;
+                    g_spi_tx_buffer[8] = (profile.min >> 0) & 0xFF;
+                    g_spi_tx_buffer[9] = (profile.min >> 8) & 0xFF;
+                    g_spi_tx_buffer[10] = (profile.min >> 16) & 0xFF;
+                    g_spi_tx_buffer[11] = (profile.min >> 24) & 0xFF;
+                    g_spi_tx_buffer[12] = (profile.max >> 0) & 0xFF;
+                    g_spi_tx_buffer[13] = (profile.max >> 8) & 0xFF;
+                    g_spi_tx_buffer[14] = (profile.max >> 16) & 0xFF;
+                    g_spi_tx_buffer[15] = (profile.max >> 24) & 0xFF;
+                    g_spi_tx_buffer[16] = (mean >> 0) & 0xFF;
+                    g_spi_tx_buffer[17] = (mean >> 8) & 0xFF;
+                    g_spi_tx_buffer[18] = (mean >> 16) & 0xFF;
+                    g_spi_tx_buffer[19] = (mean >> 24) & 0xFF;
+                    g_spi_tx_buffer[20] = (deadline >> 0) & 0xFF;
+                    g_spi_tx_buffer[21] = (deadline >> 8) & 0xFF;
+                    // Worst case seen fits the RF response delay
+                    g_spi_tx_buffer[22] = (profile.max <= (uint32_t)deadline * crypto_ticks_per_us()) ? 1 : 0;
+                    memset(&g_spi_tx_buffer[23], 0, CRYPTO_NAME_LEN);
+                    strncpy((char*)&g_spi_tx_buffer[23], crypto_profile_name(slot), CRYPTO_NAME_LEN - 1);
+                    spi_set_tx_length(23 + CRYPTO_NAME_LEN);
+                    
+                    if (g_spi_rx_buffer[2] & CRYPTO_PROFILE_FLAG_RESET) {
+                        crypto_profile_reset();
+                    }
+                    DEBUG_PRINT("SPI: GET_PROFILE %s max %lu ticks\r\n",
+                        crypto_profile_name(slot), (unsigned long)profile.max);
+                } else {
+                    g_spi_tx_buffer[0] = STATUS_ERR;
+                    spi_set_tx_length(1);
+                }
+            }
+            break;
+            
         case CMD_DEBUG_MODE:
             g_app_state.debug_enabled = true;
             g_spi_tx_buffer[0] = STATUS_OK;
@@ -0,0 +1,591 @@
+/*
+ * Hi-Tag 2 Emulator - Token Store Module
+ * Append-only, wear-levelled log of token images in flash
+ *
+ * Page layout (FLASH_PAGE_SIZE bytes):
+ *   header   magic, page sequence, erase count, ~page sequence
+ *   records  TS_RECS_PER_PAGE × 48 bytes, filled in order
+ * Record layout (12 words):
+ *   tag      'T', type ('P' put / 'D' delete), 16-bit key
+ *   sequence increases by one per record over the life of the store
+ *   image    8 page words
+ *   crc      CRC-32 of tag, sequence and image
+ *   commit   0, programmed last
+ *
+ * The tag is programmed first, so a slot whose tag is erased was never
+ * started; a record cut short anywhere after that fails the commit or
+ * CRC check and is skipped. Page headers get their magic last for the
+ * same reason, and a page whose header is not valid counts as free (it
+ * is erased at boot if anything was left in it).
+ *
+ * Pages are taken in ring order after the head, so page sequence and
+ * record sequence grow together and the oldest page (the tail) holds
+ * the oldest records. Compacting the tail copies the records the index
+ * still points at to the head and erases it; a delete record found
+ * there is dropped, as nothing older can be left anywhere else.
+ */
+
+#include "token_store.h"
+#include "flash.h"
+#include "debug.h"
+#include <string.h>
+
+// Page header (byte offsets)
+#define TS_HDR_MAGIC      0
+#define TS_HDR_SEQ        4
+#define TS_HDR_ERASES     8
+#define TS_HDR_CHECK      12
+#define TS_HDR_SIZE       16
+#define TS_PAGE_MAGIC     0x54535047UL  // "TSPG"
+
+// Record (byte offsets)
+#define TS_REC_TAG        0
+#define TS_REC_SEQ        4
+#define TS_REC_IMAGE      8
+#define TS_REC_CRC        40
+#define TS_REC_COMMIT     44
+#define TS_REC_SIZE       48
+#define TS_IMAGE_WORDS    (TOKEN_STORE_IMAGE_SIZE / 4)
+#define TS_RECS_PER_PAGE  ((FLASH_PAGE_SIZE - TS_HDR_SIZE) / TS_REC_SIZE)
+
+// Record tag
+#define TS_TAG_MAGIC      0x54000000UL  // 'T'
+#define TS_TAG_PUT        0x00500000UL  // 'P'
+#define TS_TAG_DELETE     0x00440000UL  // 'D'
+#define TS_TAG_TYPE       0x00FF0000UL
+#define TS_TAG_KEY        0x0000FFFFUL
+#define TS_COMMIT         0x00000000UL
+
+// Index entry: record offset, with TS_INDEX_DELETED for a delete record
+#define TS_INDEX_EMPTY    0xFFFFFFFFUL
+#define TS_INDEX_DELETED  0x80000000UL
+
+// Page sequence of a page outside the log
+#define TS_PAGE_FREE      0xFFFFFFFFUL
+
+// Erased pages kept back so compaction always has somewhere to copy to
+#define TS_RESERVE_PAGES  1
+
+// Newest record of every key
+static uint32_t g_ts_index[TOKEN_STORE_KEYS];
+static uint16_t g_ts_live = 0;      // Index entries in use (puts and deletes)
+
+// Per-page state
+static uint32_t g_ts_page_seq[TOKEN_STORE_MAX_PAGES];
+static uint32_t g_ts_erases[TOKEN_STORE_MAX_PAGES];
+static uint8_t g_ts_pages = 0;
+static uint8_t g_ts_free = 0;
+
+// Log head: page being filled and records in it
+static uint8_t g_ts_head = 0;
+static uint8_t g_ts_head_fill = TS_RECS_PER_PAGE;
+static bool g_ts_have_head = false;
+
+static uint32_t g_ts_next_seq = 0;
+static uint32_t g_ts_next_page_seq = 0;
+static bool g_ts_compacting = false;
+
+// Cleared by any flash error until the next token_store_init()
+static bool g_ts_ready = false;
+
+static token_store_stats_t g_ts_stats;
+
+// CRC-32 (IEEE, reflected), four bits at a time
+static const uint32_t g_ts_crc_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+/*
+ * Fold one word into a CRC, low byte first
+ */
+static uint32_t ts_crc_word(uint32_t crc, uint32_t word) {
+    for (int i = 0; i < 8; i++) {
+        crc = g_ts_crc_table[(crc ^ word) & 0xF] ^ (crc >> 4);
+        word >>= 4;
+    }
+    return crc;
+}
+
+static uint32_t ts_record_crc(uint32_t tag, uint32_t seq, const uint32_t* image) {
+    uint32_t crc = 0xFFFFFFFFUL;
+    crc = ts_crc_word(crc, tag);
+    crc = ts_crc_word(crc, seq);
+    for (int i = 0; i < TS_IMAGE_WORDS; i++) {
+        crc = ts_crc_word(crc, image[i]);
+    }
+    return ~crc;
+}
+
+static uint32_t ts_page_offset(uint8_t page) {
+    return (uint32_t)page * FLASH_PAGE_SIZE;
+}
+
+static uint32_t ts_record_offset(uint8_t page, uint8_t slot) {
+    return ts_page_offset(page) + TS_HDR_SIZE + (uint32_t)slot * TS_REC_SIZE;
+}
+
+static void ts_read_image(uint32_t offset, uint32_t* image) {
+    for (int i = 0; i < TS_IMAGE_WORDS; i++) {
+        image[i] = flash_read_word(offset + TS_REC_IMAGE + 4 * i);
+    }
+}
+
+/*
+ * Program a word, counting it; a failure stops the store
+ */
+static bool ts_write(uint32_t offset, uint32_t word) {
+    if (!flash_write_word(offset, word)) {
+        DEBUG_PRINT("Token store: write failed at %06X\r\n", offset);
+        g_ts_ready = false;
+        return false;
+    }
+    g_ts_stats.bytes_written += 4;
+    return true;
+}
+
+/*
+ * Check a started record (tag not erased)
+ * returns: false if it was cut short or is not a record
+ */
+static bool ts_record_valid(uint32_t offset, uint32_t tag) {
+    uint32_t type = tag & TS_TAG_TYPE;
+    uint32_t image[TS_IMAGE_WORDS];
+
+    if ((tag & ~(TS_TAG_TYPE | TS_TAG_KEY)) != TS_TAG_MAGIC ||
+        (type != TS_TAG_PUT && type != TS_TAG_DELETE)) {
+        return false;
+    }
+    if (flash_read_word(offset + TS_REC_COMMIT) != TS_COMMIT) {
+        return false;
+    }
+
+    ts_read_image(offset, image);
+    return flash_read_word(offset + TS_REC_CRC) ==
+           ts_record_crc(tag, flash_read_word(offset + TS_REC_SEQ), image);
+}
+
+/*
+ * Check that a page is erased apart from its erase count
+ */
+static bool ts_page_blank(uint8_t page) {
+    uint32_t base = ts_page_offset(page);
+
+    for (uint32_t offset = 0; offset < FLASH_PAGE_SIZE; offset += 4) {
+        if (offset != TS_HDR_ERASES && flash_read_word(base + offset) != FLASH_ERASED) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Erase a page and record its new erase count in the header
+ * The count survives while the page is free; the rest of the header is
+ * written when the page joins the log.
+ */
+static bool ts_erase(uint8_t page) {
+    g_ts_erases[page]++;
+    g_ts_page_seq[page] = TS_PAGE_FREE;
+
+    if (!flash_erase_page(ts_page_offset(page))) {
+        DEBUG_PRINT("Token store: erase failed on page %u\r\n", page);
+        g_ts_ready = false;
+        return false;
+    }
+    return ts_write(ts_page_offset(page) + TS_HDR_ERASES, g_ts_erases[page]);
+}
+
+/*
+ * Make the next free page after the head the new head
+ */
+static bool ts_open_page(void) {
+    uint8_t start = g_ts_have_head ? g_ts_head + 1 : 0;
+    uint8_t page = 0;
+    bool found = false;
+
+    for (uint8_t i = 0; i < g_ts_pages && !found; i++) {
+        page = (start + i) % g_ts_pages;
+        found = (g_ts_page_seq[page] == TS_PAGE_FREE);
+    }
+    if (!found) {
+        return false;
+    }
+
+    uint32_t base = ts_page_offset(page);
+    uint32_t seq = g_ts_next_page_seq;
+    if (!ts_write(base + TS_HDR_SEQ, seq) ||
+        !ts_write(base + TS_HDR_CHECK, ~seq) ||
+        !ts_write(base + TS_HDR_MAGIC, TS_PAGE_MAGIC)) {
+        return false;
+    }
+
+    g_ts_next_page_seq++;
+    g_ts_page_seq[page] = seq;
+    g_ts_free--;
+    g_ts_head = page;
+    g_ts_head_fill = 0;
+    g_ts_have_head = true;
+    return true;
+}
+
+/*
+ * Oldest page in the log other than the head
+ * returns: -1 if the head is the only one
+ */
+static int ts_tail(void) {
+    int tail = -1;
+
+    for (uint8_t p = 0; p < g_ts_pages; p++) {
+        if (g_ts_page_seq[p] == TS_PAGE_FREE || (g_ts_have_head && p == g_ts_head)) {
+            continue;
+        }
+        if (tail < 0 || g_ts_page_seq[p] < g_ts_page_seq[tail]) {
+            tail = p;
+        }
+    }
+    return tail;
+}
+
+static bool ts_append(uint16_t key, uint32_t type, const uint32_t* image);
+
+/*
+ * Copy the live records of a page to the head and erase it
+ */
+static bool ts_compact(uint8_t page) {
+    uint32_t image[TS_IMAGE_WORDS];
+
+    g_ts_compacting = true;
+    for (uint8_t slot = 0; slot < TS_RECS_PER_PAGE; slot++) {
+        uint32_t offset = ts_record_offset(page, slot);
+        uint32_t tag = flash_read_word(offset + TS_REC_TAG);
+
+        if (tag == FLASH_ERASED) {
+            break;
+        }
+
+        uint16_t key = tag & TS_TAG_KEY;
+        if (key >= TOKEN_STORE_KEYS || (g_ts_index[key] & ~TS_INDEX_DELETED) != offset) {
+            continue;   // Superseded or cut short
+        }
+
+        if (g_ts_index[key] & TS_INDEX_DELETED) {
+            g_ts_index[key] = TS_INDEX_EMPTY;
+            g_ts_live--;
+            continue;
+        }
+
+        ts_read_image(offset, image);
+        if (!ts_append(key, TS_TAG_PUT, image)) {
+            g_ts_compacting = false;
+            return false;
+        }
+        g_ts_stats.copies++;
+    }
+    g_ts_compacting = false;
+
+    if (!ts_erase(page)) {
+        return false;
+    }
+    g_ts_free++;
+    g_ts_stats.compactions++;
+    return true;
+}
+
+/*
+ * Append a record at the head and point the index at it
+ *
+ * When the head is full and only the reserve is free, the tail is
+ * compacted first. Records copied by compaction may use the reserve;
+ * a page of copies never needs more than the page it frees.
+ */
+static bool ts_append(uint16_t key, uint32_t type, const uint32_t* image) {
+    if (!g_ts_have_head || g_ts_head_fill >= TS_RECS_PER_PAGE) {
+        if (!g_ts_compacting) {
+            for (uint8_t i = 0; i < g_ts_pages && g_ts_free <= TS_RESERVE_PAGES; i++) {
+                int tail = ts_tail();
+                if (tail < 0 || !ts_compact((uint8_t)tail)) {
+                    return false;
+                }
+                if (g_ts_head_fill < TS_RECS_PER_PAGE) {
+                    break;
+                }
+            }
+            if (g_ts_head_fill >= TS_RECS_PER_PAGE && g_ts_free <= TS_RESERVE_PAGES) {
+                return false;
+            }
+        }
+        if (g_ts_head_fill >= TS_RECS_PER_PAGE && !ts_open_page()) {
+            return false;
+        }
+    }
+
+    uint32_t offset = ts_record_offset(g_ts_head, g_ts_head_fill);
+    uint32_t tag = TS_TAG_MAGIC | type | key;
+    uint32_t seq = g_ts_next_seq;
+
+    g_ts_head_fill++;
+    g_ts_next_seq++;
+
+    if (!ts_write(offset + TS_REC_TAG, tag) ||
+        !ts_write(offset + TS_REC_SEQ, seq)) {
+        return false;
+    }
+    for (int i = 0; i < TS_IMAGE_WORDS; i++) {
+        if (!ts_write(offset + TS_REC_IMAGE + 4 * i, image[i])) {
+            return false;
+        }
+    }
+    if (!ts_write(offset + TS_REC_CRC, ts_record_crc(tag, seq, image)) ||
+        !ts_write(offset + TS_REC_COMMIT, TS_COMMIT)) {
+        return false;
+    }
+
+    if (g_ts_index[key] == TS_INDEX_EMPTY) {
+        g_ts_live++;
+    }
+    g_ts_index[key] = offset | ((type == TS_TAG_DELETE) ? TS_INDEX_DELETED : 0);
+    return true;
+}
+
+/*
+ * Most keys the log can hold with a page's worth of slack for compaction
+ */
+static uint16_t ts_capacity(void) {
+    uint32_t capacity = (uint32_t)(g_ts_pages - TS_RESERVE_PAGES - 1) * TS_RECS_PER_PAGE;
+    return (capacity < TOKEN_STORE_KEYS) ? capacity : TOKEN_STORE_KEYS;
+}
+
+/*
+ * Build the index from the region
+ *
+ * One pass in address order: each valid record replaces the index entry
+ * of its key if its sequence is newer. The head is the page with the
+ * newest page sequence, and appending resumes at its first unstarted
+ * slot. Free pages holding anything (a header or an erase cut short)
+ * are erased here.
+ */
+bool token_store_init(void) {
+    uint32_t size = flash_size() / FLASH_PAGE_SIZE;
+    uint32_t head_seq = 0;
+
+    g_ts_ready = false;
+    g_ts_pages = (size < TOKEN_STORE_MAX_PAGES) ? size : TOKEN_STORE_MAX_PAGES;
+    if (g_ts_pages < TS_RESERVE_PAGES + 2) {
+        return false;
+    }
+
+    memset(&g_ts_stats, 0, sizeof(g_ts_stats));
+    for (uint16_t k = 0; k < TOKEN_STORE_KEYS; k++) {
+        g_ts_index[k] = TS_INDEX_EMPTY;
+    }
+    g_ts_live = 0;
+    g_ts_free = 0;
+    g_ts_have_head = false;
+    g_ts_head_fill = TS_RECS_PER_PAGE;
+    g_ts_next_seq = 0;
+    g_ts_next_page_seq = 0;
+    g_ts_compacting = false;
+
+    for (uint8_t p = 0; p < g_ts_pages; p++) {
+        uint32_t base = ts_page_offset(p);
+        uint32_t seq = flash_read_word(base + TS_HDR_SEQ);
+        uint32_t erases = flash_read_word(base + TS_HDR_ERASES);
+
+        g_ts_erases[p] = (erases == FLASH_ERASED) ? 0 : erases;
+
+        if (flash_read_word(base + TS_HDR_MAGIC) != TS_PAGE_MAGIC ||
+            flash_read_word(base + TS_HDR_CHECK) != ~seq || seq == TS_PAGE_FREE) {
+            g_ts_page_seq[p] = TS_PAGE_FREE;
+            if (!ts_page_blank(p) && !ts_erase(p)) {
+                return false;
+            }
+            g_ts_free++;
+            continue;
+        }
+
+        g_ts_page_seq[p] = seq;
+        if (seq >= g_ts_next_page_seq) {
+            g_ts_next_page_seq = seq + 1;
+        }
+
+        uint8_t fill = TS_RECS_PER_PAGE;
+        for (uint8_t slot = 0; slot < TS_RECS_PER_PAGE; slot++) {
+            uint32_t offset = ts_record_offset(p, slot);
+            uint32_t tag = flash_read_word(offset + TS_REC_TAG);
+
+            if (tag == FLASH_ERASED) {
+                fill = slot;
+                break;
+            }
+            if (!ts_record_valid(offset, tag)) {
+                continue;
+            }
+
+            uint32_t rec_seq = flash_read_word(offset + TS_REC_SEQ);
+            uint16_t key = tag & TS_TAG_KEY;
+            if (rec_seq >= g_ts_next_seq) {
+                g_ts_next_seq = rec_seq + 1;
+            }
+            if (key >= TOKEN_STORE_KEYS) {
+                continue;
+            }
+
+            uint32_t entry = g_ts_index[key];
+            if (entry == TS_INDEX_EMPTY ||
+                rec_seq > flash_read_word((entry & ~TS_INDEX_DELETED) + TS_REC_SEQ)) {
+                if (entry == TS_INDEX_EMPTY) {
+                    g_ts_live++;
+                }
+                g_ts_index[key] = offset |
+                    (((tag & TS_TAG_TYPE) == TS_TAG_DELETE) ? TS_INDEX_DELETED : 0);
+            }
+        }
+
+        if (!g_ts_have_head || seq > head_seq) {
+            g_ts_head = p;
+            g_ts_head_fill = fill;
+            g_ts_have_head = true;
+            head_seq = seq;
+        }
+    }
+
+    g_ts_ready = true;
+    DEBUG_PRINT("Token store: %u pages, %u free, %u keys\r\n",
+        g_ts_pages, g_ts_free, g_ts_live);
+    return true;
+}
+
+/*
+ * Erase the whole region and start an empty log
+ */
+bool token_store_format(void) {
+    uint32_t size = flash_size() / FLASH_PAGE_SIZE;
+    uint8_t pages = (size < TOKEN_STORE_MAX_PAGES) ? size : TOKEN_STORE_MAX_PAGES;
+
+    for (uint8_t p = 0; p < pages; p++) {
+        uint32_t erases = flash_read_word(ts_page_offset(p) + TS_HDR_ERASES);
+        g_ts_erases[p] = (erases == FLASH_ERASED) ? 0 : erases;
+        if (!ts_erase(p)) {
+            return false;
+        }
+    }
+    return token_store_init();
+}
+
+/*
+ * Store a token image under key
+ * An image equal to the stored one is not written again.
+ * returns: false if the key is out of range, the store is full or the
+ *          flash failed
+ */
+bool token_store_put(uint16_t key, const uint8_t* image) {
+    uint32_t words[TS_IMAGE_WORDS];
+
+    if (!g_ts_ready || key >= TOKEN_STORE_KEYS) {
+        return false;
+    }
+
+    for (int i = 0; i < TS_IMAGE_WORDS; i++) {
+        words[i] = ((uint32_t)image[i * 4 + 0] << 0) |
+                   ((uint32_t)image[i * 4 + 1] << 8) |
+                   ((uint32_t)image[i * 4 + 2] << 16) |
+                   ((uint32_t)image[i * 4 + 3] << 24);
+    }
+
+    uint32_t entry = g_ts_index[key];
+    if (entry == TS_INDEX_EMPTY && g_ts_live >= ts_capacity()) {
+        return false;
+    }
+    if (entry != TS_INDEX_EMPTY && !(entry & TS_INDEX_DELETED)) {
+        uint32_t stored[TS_IMAGE_WORDS];
+        ts_read_image(entry, stored);
+        if (memcmp(stored, words, sizeof(words)) == 0) {
+            return true;
+        }
+    }
+
+    if (!ts_append(key, TS_TAG_PUT, words)) {
+        return false;
+    }
+    g_ts_stats.puts++;
+    return true;
+}
+
+/*
+ * Read the token image stored under key
+ * returns: false if the key holds no token
+ */
+bool token_store_get(uint16_t key, uint8_t* image) {
+    uint32_t words[TS_IMAGE_WORDS];
+
+    if (!token_store_has(key)) {
+        return false;
+    }
+
+    ts_read_image(g_ts_index[key], words);
+    for (int i = 0; i < TS_IMAGE_WORDS; i++) {
+        image[i * 4 + 0] = (words[i] >> 0) & 0xFF;
+        image[i * 4 + 1] = (words[i] >> 8) & 0xFF;
+        image[i * 4 + 2] = (words[i] >> 16) & 0xFF;
+        image[i * 4 + 3] = (words[i] >> 24) & 0xFF;
+    }
+    return true;
+}
+
+/*
+ * Remove the token stored under key
+ * returns: true if the key holds no token afterwards
+ */
+bool token_store_delete(uint16_t key) {
+    uint32_t blank[TS_IMAGE_WORDS];
+
+    if (!g_ts_ready || key >= TOKEN_STORE_KEYS) {
+        return false;
+    }
+    if (!token_store_has(key)) {
+        return true;
+    }
+
+    memset(blank, 0, sizeof(blank));
+    if (!ts_append(key, TS_TAG_DELETE, blank)) {
+        return false;
+    }
+    g_ts_stats.puts++;
+    return true;
+}
+
+/*
+ * Check whether key holds a token
+ */
+bool token_store_has(uint16_t key) {
+    return g_ts_ready && key < TOKEN_STORE_KEYS &&
+           g_ts_index[key] != TS_INDEX_EMPTY && !(g_ts_index[key] & TS_INDEX_DELETED);
+}
+
+/*
+ * Report usage and wear
+ */
+void token_store_stats(token_store_stats_t* stats) {
+    *stats = g_ts_stats;
+    stats->keys = 0;
+    for (uint16_t k = 0; k < TOKEN_STORE_KEYS; k++) {
+        if (token_store_has(k)) {
+            stats->keys++;
+        }
+    }
+    stats->pages = g_ts_pages;
+    stats->free_pages = g_ts_free;
+    stats->min_erase = g_ts_pages ? g_ts_erases[0] : 0;
+    stats->max_erase = stats->min_erase;
+    for (uint8_t p = 1; p < g_ts_pages; p++) {
+        if (g_ts_erases[p] < stats->min_erase) {
+            stats->min_erase = g_ts_erases[p];
+        }
+        if (g_ts_erases[p] > stats->max_erase) {
+            stats->max_erase = g_ts_erases[p];
+        }
+    }
+}
@@ -0,0 +1,350 @@
+/*
+ * Hi-Tag 2 Emulator - Cross-Implementation Comparison
+ * Runs every cipher implementation in crypto.c on the same random inputs
+ * and reports where they diverge and how fast each one is
+ *
+ * Usage: crypto_compare [options]
+ *   -n N       random inputs per group (default 4000000)
+ *   -s SEED    input generator seed (hex, default 1)
+ *
+ * Two groups of implementations are compared:
+ *
+ * Responses (key, UID, challenge -> 32 bits): every backend in the
+ * registry (crypto_compute_response() runs the pinned one), the legacy
+ * crypto_compute_response_v2() and every batch kernel this CPU supports.
+ * The first row is the bit-serial reference, checked against the
+ * published known answer.
+ *
+ * LFSRs (48-bit state -> state after 32 steps): crypto_lfsr_jump() for
+ * the Hi-Tag 2 LFSR, crypto_lfsr_simple(), crypto_lfsr_shift(), the
+ * GF(2) jump-ahead for the simple taps, and a bit-serial model of each
+ * LFSR written from the tap lists in the crypto.c comments.
+ *
+ * For each group the tool prints ns per call, calls per second, the
+ * number of inputs that differ from the first row (with the first such
+ * input) and an agreement matrix. Unrelated functions agree on ~0% of
+ * inputs; an implementation of the same function agrees on 100%.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "crypto.h"
+
+#define BLOCK           65536       // Inputs per timed block
+#define MAX_IMPLS       16
+
+// Pre-shift tap mask of crypto_lfsr_simple (taps 44, 31, 21, 1 after the shift)
+#define SIMPLE_TAPS     ((1ULL << 45) | (1ULL << 32) | (1ULL << 22) | (1ULL << 2))
+
+typedef uint64_t (*lfsr_fn_t)(uint64_t state);
+
+// One implementation under test
+typedef struct {
+    char name[32];
+    crypto_response_fn_t response;  // Response group: single call
+    crypto_kernel_t kernel;         // Response group: batch kernel (if no response fn)
+    lfsr_fn_t lfsr;                 // LFSR group
+    bool kat;                       // Matches the published known answer
+    double ns;                      // Total time
+    uint64_t mismatches;            // Inputs differing from the first row
+    uint64_t first_input[3];        // First differing input
+    uint64_t first_value[2];        // Outputs of this row and the first row there
+} impl_t;
+
+// Inputs of one block
+static hitag2_key_t g_keys[BLOCK];
+static uint32_t g_uids[BLOCK];
+static uint32_t g_challenges[BLOCK];
+static uint64_t g_states[BLOCK];
+
+// Outputs of every implementation for the current block
+static uint64_t g_out[MAX_IMPLS][BLOCK];
+static uint64_t g_agree[MAX_IMPLS][MAX_IMPLS];
+
+/*
+ * Hi-Tag 2 LFSR step as published (feedback before the shift)
+ */
+static uint64_t model_hitag2_step(uint64_t x) {
+    uint64_t feedback = (x >> 0) ^ (x >> 2) ^ (x >> 3) ^ (x >> 6) ^
+                        (x >> 7) ^ (x >> 8) ^ (x >> 16) ^ (x >> 22) ^
+                        (x >> 23) ^ (x >> 26) ^ (x >> 30) ^ (x >> 41) ^
+                        (x >> 42) ^ (x >> 43) ^ (x >> 46) ^ (x >> 47);
+    return (x >> 1) | ((feedback & 1) << 47);
+}
+
+/*
+ * crypto_lfsr_simple step: shift, then taps 44, 31, 21, 1 into bit 47
+ */
+static uint64_t model_simple_step(uint64_t x) {
+    x >>= 1;
+    return x | ((((x >> 44) ^ (x >> 31) ^ (x >> 21) ^ (x >> 1)) & 1) << 47);
+}
+
+/*
+ * crypto_lfsr_shift step: each byte shifts on its own (no carry), then
+ * taps 36, 35, 31, 21, 12 into bit 47
+ */
+static uint64_t model_shift_step(uint64_t x) {
+    x = (x >> 1) & 0x7F7F7F7F7F7FULL;
+    return x | ((((x >> 36) ^ (x >> 35) ^ (x >> 31) ^ (x >> 21) ^ (x >> 12)) & 1) << 47);
+}
+
+static uint64_t model_run(uint64_t x, uint64_t (*step)(uint64_t)) {
+    for (int i = 0; i < 32; i++) {
+        x = step(x);
+    }
+    return x;
+}
+
+static uint64_t lfsr_hitag2_model(uint64_t x) { return model_run(x, model_hitag2_step); }
+static uint64_t lfsr_simple_model(uint64_t x) { return model_run(x, model_simple_step); }
+static uint64_t lfsr_shift_model(uint64_t x) { return model_run(x, model_shift_step); }
+
+static uint64_t lfsr_hitag2_jump(uint64_t x) {
+    return crypto_lfsr_jump(x, 32);
+}
+
+static uint64_t lfsr_simple_jump(uint64_t x) {
+    return crypto_lfsr_jump_taps(x, 32, SIMPLE_TAPS);
+}
+
+static uint64_t lfsr_simple(uint64_t x) {
+    uint64_t state;
+    crypto_lfsr_simple(x, 32, &state);
+    return state;
+}
+
+static uint64_t lfsr_shift(uint64_t x) {
+    uint8_t state[6];
+
+    for (int j = 0; j < 6; j++) {
+        state[j] = (x >> (8 * j)) & 0xFF;
+    }
+    crypto_lfsr_shift(state, 32);
+
+    x = 0;
+    for (int j = 0; j < 6; j++) {
+        x |= (uint64_t)state[j] << (8 * j);
+    }
+    return x;
+}
+
+/*
+ * Step a xorshift64 generator
+ */
+static uint64_t next_random(uint64_t* seed) {
+    uint64_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *seed = x;
+    return x;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * Run one implementation on the current block
+ */
+static void run_block(impl_t* impl, uint64_t* out, uint32_t n) {
+    static uint32_t responses[BLOCK];
+    double t0 = now_ns();
+
+    if (impl->lfsr) {
+        for (uint32_t i = 0; i < n; i++) {
+            out[i] = impl->lfsr(g_states[i]);
+        }
+    } else if (impl->response) {
+        for (uint32_t i = 0; i < n; i++) {
+            out[i] = impl->response(g_keys[i].bytes, g_uids[i], g_challenges[i]);
+        }
+    } else {
+        crypto_batch_set_kernel(impl->kernel);
+        crypto_compute_response_batch(g_keys, g_uids, g_challenges, responses, n);
+    }
+
+    impl->ns += now_ns() - t0;
+
+    if (!impl->lfsr && !impl->response) {
+        for (uint32_t i = 0; i < n; i++) {
+            out[i] = responses[i];
+        }
+    }
+}
+
+/*
+ * Run a group of implementations over n random inputs and print the report
+ */
+static void run_group(const char* title, impl_t* impls, int count, uint64_t n, uint64_t seed) {
+    memset(g_agree, 0, sizeof(g_agree));
+
+    for (uint64_t done = 0; done < n; done += BLOCK) {
+        uint32_t block = (n - done < BLOCK) ? (uint32_t)(n - done) : BLOCK;
+
+        for (uint32_t i = 0; i < block; i++) {
+            uint64_t r = next_random(&seed);
+            for (int j = 0; j < 6; j++) {
+                g_keys[i].bytes[j] = (r >> (8 * j)) & 0xFF;
+            }
+            g_uids[i] = (uint32_t)next_random(&seed);
+            g_challenges[i] = (uint32_t)next_random(&seed);
+            g_states[i] = r & 0xFFFFFFFFFFFFULL;
+        }
+
+        for (int k = 0; k < count; k++) {
+            run_block(&impls[k], g_out[k], block);
+        }
+
+        for (int k = 0; k < count; k++) {
+            for (uint32_t i = 0; i < block; i++) {
+                if (g_out[k][i] != g_out[0][i] && impls[k].mismatches++ == 0) {
+                    impls[k].first_input[0] = impls[k].lfsr ? g_states[i] :
+                        ((uint64_t)g_keys[i].bytes[5] << 40) | ((uint64_t)g_keys[i].bytes[4] << 32) |
+                        ((uint64_t)g_keys[i].bytes[3] << 24) | ((uint64_t)g_keys[i].bytes[2] << 16) |
+                        ((uint64_t)g_keys[i].bytes[1] << 8) | g_keys[i].bytes[0];
+                    impls[k].first_input[1] = g_uids[i];
+                    impls[k].first_input[2] = g_challenges[i];
+                    impls[k].first_value[0] = g_out[k][i];
+                    impls[k].first_value[1] = g_out[0][i];
+                }
+                for (int m = k + 1; m < count; m++) {
+                    g_agree[k][m] += g_out[k][i] == g_out[m][i];
+                }
+            }
+        }
+    }
+
+    printf("%s, %" PRIu64 " inputs\n\n", title, n);
+    printf("  #  %-20s %5s %10s %10s %12s\n", "implementation", "KAT", "ns/call", "Mcalls/s", "vs #0");
+    for (int k = 0; k < count; k++) {
+        impl_t* impl = &impls[k];
+        double ns = impl->ns / n;
+
+        printf("  %-2d %-20s %5s %10.1f %10.2f %12" PRIu64 "\n", k, impl->name,
+               impl->lfsr ? "-" : (impl->kat ? "pass" : "FAIL"), ns, 1e3 / ns, impl->mismatches);
+    }
+
+    printf("\n");
+    for (int k = 1; k < count; k++) {
+        impl_t* impl = &impls[k];
+        if (impl->mismatches == 0) {
+            continue;
+        }
+        if (impl->lfsr) {
+            printf("  #%d diverges from #0 at state %012" PRIX64 ": %012" PRIX64 " vs %012" PRIX64 "\n",
+                   k, impl->first_input[0], impl->first_value[0], impl->first_value[1]);
+        } else {
+            printf("  #%d diverges from #0 at key %012" PRIX64 " uid %08" PRIX64 " challenge %08" PRIX64
+                   ": %08" PRIX64 " vs %08" PRIX64 "\n", k, impl->first_input[0],
+                   impl->first_input[1], impl->first_input[2], impl->first_value[0],
+                   impl->first_value[1]);
+        }
+    }
+
+    printf("\n  agreement %%  ");
+    for (int m = 0; m < count; m++) {
+        printf("%6d", m);
+    }
+    printf("\n");
+    for (int k = 0; k < count; k++) {
+        printf("  %-12d", k);
+        for (int m = 0; m < count; m++) {
+            uint64_t same = (k == m) ? n : (k < m) ? g_agree[k][m] : g_agree[m][k];
+            printf("%6.1f", 100.0 * same / n);
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: crypto_compare [-n inputs] [-s seed]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    static const hitag2_key_t kat_key = {{0x52, 0x4B, 0x49, 0x4D, 0x4E, 0x4F}};
+    uint64_t n = 4000000;
+    uint64_t seed = 1;
+    impl_t impls[MAX_IMPLS];
+    int count = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n': n = strtoull(optarg, NULL, 0); break;
+            case 's': seed = strtoull(optarg, NULL, 16); break;
+            default: usage();
+        }
+    }
+    if (n == 0 || seed == 0) {
+        usage();
+    }
+
+    crypto_init();
+    crypto_kernel_t kernel = crypto_batch_get_kernel();
+
+    // Responses: registry backends, then the batch kernels
+    memset(impls, 0, sizeof(impls));
+    for (uint8_t i = 0; i < crypto_backend_count() && count < MAX_IMPLS; i++) {
+        const crypto_backend_t* backend = crypto_backend_get(i);
+        snprintf(impls[count].name, sizeof(impls[count].name), "%s%s", backend->name,
+                 (i == crypto_backend_active()) ? " (active)" : "");
+        impls[count].response = backend->compute;
+        count++;
+    }
+    for (crypto_kernel_t k = CRYPTO_KERNEL_SCALAR; k < CRYPTO_KERNEL_COUNT && count < MAX_IMPLS; k++) {
+        if (crypto_batch_kernel_supported(k)) {
+            snprintf(impls[count].name, sizeof(impls[count].name), "batch %s",
+                     crypto_batch_kernel_name(k));
+            impls[count].kernel = k;
+            count++;
+        }
+    }
+    for (int k = 0; k < count; k++) {
+        uint32_t uid = 0x49434957UL, challenge = 0x4B4E4F52UL, response;
+        if (impls[k].response) {
+            response = impls[k].response(kat_key.bytes, uid, challenge);
+        } else {
+            crypto_batch_set_kernel(impls[k].kernel);
+            crypto_compute_response_batch(&kat_key, &uid, &challenge, &response, 1);
+        }
+        impls[k].kat = response == 0x6C416796UL;
+    }
+
+    run_group("Responses", impls, count, n, seed);
+    crypto_batch_set_kernel(kernel);
+
+    // LFSRs: each library routine next to the model of its taps
+    static const struct {
+        const char* name;
+        lfsr_fn_t fn;
+    } lfsrs[] = {
+        {"hitag2 model",        lfsr_hitag2_model},
+        {"crypto_lfsr_jump",    lfsr_hitag2_jump},
+        {"simple model",        lfsr_simple_model},
+        {"crypto_lfsr_simple",  lfsr_simple},
+        {"jump (simple taps)",  lfsr_simple_jump},
+        {"shift model",         lfsr_shift_model},
+        {"crypto_lfsr_shift",   lfsr_shift},
+    };
+
+    memset(impls, 0, sizeof(impls));
+    count = sizeof(lfsrs) / sizeof(lfsrs[0]);
+    for (int k = 0; k < count; k++) {
+        snprintf(impls[k].name, sizeof(impls[k].name), "%s", lfsrs[k].name);
+        impls[k].lfsr = lfsrs[k].fn;
+    }
+
+    run_group("LFSRs (state after 32 steps)", impls, count, n, seed);
+    return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * Hi-Tag 2 Emulator - Crypto Timing Harness
+ * Measures the cost of single responses per backend and tests whether
+ * it depends on the input
+ *
+ * Usage: crypto_timing [options]
+ *   -n N       samples per backend (default 200000)
+ *   -b NAME    only measure this backend
+ *   -s SEED    input generator seed (hex, default 1)
+ *
+ * Each sample times one backend->compute() call with the cycle counter
+ * (rdtsc on x86, monotonic nanoseconds elsewhere). Samples alternate at
+ * random between two classes (a fixed key/UID/challenge and random
+ * ones) and a Welch t-test compares the classes: |t| above 4.5 means
+ * the timing depends on the input. Samples above the 99th percentile
+ * (interrupts, migrations) are dropped before the statistics.
+ *
+ * The spread of the random class is the jitter the RF reply would see
+ * with that backend; a constant-time backend shows a small spread and
+ * |t| close to 0.
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "crypto.h"
+
+#define LEAK_THRESHOLD  4.5     // |t| above this: input-dependent timing
+#define CROP_PERCENTILE 0.99
+
+// One timed call
+typedef struct {
+    uint8_t key[6];
+    uint8_t fixed;              // Class: 1 = fixed input, 0 = random
+    uint32_t uid;
+    uint32_t challenge;
+    uint32_t cycles;
+} sample_t;
+
+// Running mean/variance (Welford)
+typedef struct {
+    double n;
+    double mean;
+    double m2;
+} stats_t;
+
+static volatile uint32_t g_sink;
+
+/*
+ * Read the cycle counter, serialized against the timed call
+ */
+static inline uint64_t cycles_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_lfence();
+    uint64_t t = __rdtsc();
+    _mm_lfence();
+    return t;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/*
+ * Step a xorshift64 generator
+ */
+static uint64_t next_random(uint64_t* seed) {
+    uint64_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *seed = x;
+    return x;
+}
+
+static void stats_add(stats_t* s, double x) {
+    double delta = x - s->mean;
+    s->n += 1;
+    s->mean += delta / s->n;
+    s->m2 += delta * (x - s->mean);
+}
+
+static double stats_var(const stats_t* s) {
+    return (s->n > 1) ? s->m2 / (s->n - 1) : 0.0;
+}
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Fill the inputs of both classes in random order
+ */
+static void make_inputs(sample_t* samples, uint32_t n, uint64_t seed) {
+    uint64_t fixed = next_random(&seed);
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t r = next_random(&seed);
+        sample_t* s = &samples[i];
+
+        s->fixed = next_random(&seed) & 1;
+        if (s->fixed) {
+            r = fixed;
+        }
+        for (int j = 0; j < 6; j++) {
+            s->key[j] = (r >> (8 * j)) & 0xFF;
+        }
+        s->uid = (s->fixed) ? (uint32_t)(fixed >> 16) : (uint32_t)next_random(&seed);
+        s->challenge = (s->fixed) ? (uint32_t)(fixed >> 32) : (uint32_t)next_random(&seed);
+    }
+}
+
+/*
+ * Time every sample with one backend and print its statistics
+ */
+static void measure(const crypto_backend_t* backend, sample_t* samples, uint32_t n,
+                    uint32_t* sorted) {
+    // Warm up caches and branch predictors on the same inputs
+    for (uint32_t i = 0; i < n / 10; i++) {
+        g_sink ^= backend->compute(samples[i].key, samples[i].uid, samples[i].challenge);
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        sample_t* s = &samples[i];
+        uint64_t t0 = cycles_now();
+        uint32_t r = backend->compute(s->key, s->uid, s->challenge);
+        uint64_t t1 = cycles_now();
+
+        g_sink ^= r;
+        s->cycles = (uint32_t)(t1 - t0);
+        sorted[i] = s->cycles;
+    }
+
+    qsort(sorted, n, sizeof(uint32_t), compare_u32);
+    uint32_t crop = sorted[(uint32_t)(n * CROP_PERCENTILE)];
+
+    stats_t all = {0}, cls[2] = {{0}};
+    for (uint32_t i = 0; i < n; i++) {
+        if (samples[i].cycles <= crop) {
+            stats_add(&all, samples[i].cycles);
+            stats_add(&cls[samples[i].fixed], samples[i].cycles);
+        }
+    }
+
+    double se = sqrt(stats_var(&cls[0]) / cls[0].n + stats_var(&cls[1]) / cls[1].n);
+    double t = (se > 0) ? (cls[1].mean - cls[0].mean) / se : 0.0;
+
+    printf("%-10s %8.1f %8.2f %6" PRIu32 " %6" PRIu32 " %6" PRIu32 " %6" PRIu32 " %8.2f %8.2f  %s\n",
+           backend->name, all.mean, sqrt(stats_var(&all)), sorted[0], sorted[n / 2],
+           crop, sorted[n - 1], sqrt(stats_var(&cls[0])), t,
+           (fabs(t) > LEAK_THRESHOLD) ? "LEAK" : "ok");
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: crypto_timing [-n samples] [-b backend] [-s seed]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    uint32_t n = 200000;
+    const char* only = NULL;
+    uint64_t seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:b:s:")) != -1) {
+        switch (opt) {
+            case 'n': n = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'b': only = optarg; break;
+            case 's': seed = strtoull(optarg, NULL, 16); break;
+            default: usage();
+        }
+    }
+    if (n < 100 || seed == 0) {
+        usage();
+    }
+
+    sample_t* samples = malloc(n * sizeof(sample_t));
+    uint32_t* sorted = malloc(n * sizeof(uint32_t));
+    if (!samples || !sorted) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    crypto_init();
+    make_inputs(samples, n, seed);
+
+#if defined(__x86_64__) || defined(__i386__)
+    const char* unit = "TSC cycles";
+#else
+    const char* unit = "ns";
+#endif
+    printf("%" PRIu32 " samples per backend, %s, |t| > %.1f = input-dependent\n\n",
+           n, unit, LEAK_THRESHOLD);
+    printf("%-10s %8s %8s %6s %6s %6s %6s %8s %8s\n",
+           "backend", "mean", "stddev", "min", "median", "p99", "max", "rnd-sd", "t");
+
+    for (uint8_t i = 0; i < crypto_backend_count(); i++) {
+        const crypto_backend_t* backend = crypto_backend_get(i);
+
+        if (!(backend->caps & CRYPTO_CAP_HITAG2) || (only && strcmp(only, backend->name) != 0)) {
+            continue;
+        }
+        measure(backend, samples, n, sorted);
+    }
+
+    free(samples);
+    free(sorted);
+    return 0;
+}
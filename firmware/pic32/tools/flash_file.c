@@ -0,0 +1,128 @@
+/*
+ * Hi-Tag 2 Emulator - File-Backed Flash
+ * Host stand-in for src/flash.c: the region is a file mapped into memory
+ *
+ * NOR rules are enforced rather than assumed: programming a word that is
+ * not erased fails, and so does an unaligned access, so a token store bug
+ * that would corrupt real flash shows up on the host. A power cut is
+ * simulated with flash_file_fail_after(): the store sees its writes
+ * start failing part way through a record or an erase (the erase then
+ * leaves the page half cleared).
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "flash.h"
+
+static uint32_t* g_flash = NULL;
+static uint32_t g_flash_size = 0;
+static int g_flash_fd = -1;
+
+// Programs left before the simulated power cut (UINT32_MAX: never)
+static uint32_t g_flash_budget = UINT32_MAX;
+
+/*
+ * Map a backing file of size bytes
+ * New or grown files read as erased flash.
+ */
+bool flash_file_open(const char* path, uint32_t size) {
+    struct stat st;
+
+    if (size == 0 || size % FLASH_PAGE_SIZE != 0) {
+        return false;
+    }
+    flash_file_close();
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    if (fstat(fd, &st) != 0 || ftruncate(fd, size) != 0) {
+        perror(path);
+        close(fd);
+        return false;
+    }
+
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror(path);
+        close(fd);
+        return false;
+    }
+    if ((uint64_t)st.st_size < size) {
+        memset((uint8_t*)map + st.st_size, 0xFF, size - st.st_size);
+    }
+
+    g_flash = map;
+    g_flash_size = size;
+    g_flash_fd = fd;
+    g_flash_budget = UINT32_MAX;
+    return true;
+}
+
+/*
+ * Unmap the backing file (contents stay on disk)
+ */
+void flash_file_close(void) {
+    if (g_flash) {
+        munmap(g_flash, g_flash_size);
+        close(g_flash_fd);
+    }
+    g_flash = NULL;
+    g_flash_size = 0;
+    g_flash_fd = -1;
+    g_flash_budget = UINT32_MAX;
+}
+
+void flash_file_fail_after(uint32_t words) {
+    g_flash_budget = words;
+}
+
+uint32_t flash_size(void) {
+    return g_flash_size;
+}
+
+uint32_t flash_read_word(uint32_t offset) {
+    if (!g_flash || offset >= g_flash_size || (offset & 3)) {
+        return FLASH_ERASED;
+    }
+    return g_flash[offset / 4];
+}
+
+bool flash_write_word(uint32_t offset, uint32_t word) {
+    if (!g_flash || offset >= g_flash_size || (offset & 3)) {
+        return false;
+    }
+    if (g_flash_budget == 0) {
+        return false;
+    }
+    if (g_flash_budget != UINT32_MAX) {
+        g_flash_budget--;
+    }
+    if (g_flash[offset / 4] != FLASH_ERASED) {
+        return false;
+    }
+    g_flash[offset / 4] = word;
+    return true;
+}
+
+bool flash_erase_page(uint32_t offset) {
+    if (!g_flash || offset >= g_flash_size) {
+        return false;
+    }
+
+    uint32_t* page = &g_flash[(offset & ~(uint32_t)(FLASH_PAGE_SIZE - 1)) / 4];
+    if (g_flash_budget == 0) {
+        // Cut mid-erase: the first half is cleared, the rest is not
+        memset(page, 0xFF, FLASH_PAGE_SIZE / 2);
+        return false;
+    }
+    memset(page, 0xFF, FLASH_PAGE_SIZE);
+    return true;
+}
@@ -0,0 +1,154 @@
+/*
+ * Hi-Tag 2 Emulator - Crypto Table Generator
+ * Build step that emits the byte-stepping tables used by crypto.c
+ *
+ * Usage: gen_crypto_tables > crypto_tables.h
+ *
+ * Each LFSR is described here once, by its bit-serial reference step.
+ * The tables are derived by running that step, so the firmware never
+ * carries hand-written constants that could drift from the reference.
+ *
+ * Linear LFSRs (Hi-Tag 2, crypto_lfsr_shift, crypto_lfsr_simple):
+ * The 8 feedback bits produced over a byte of steps are linear in the
+ * state, so they are the XOR of one table entry per state byte:
+ * Feedback = T[0][S0] ^ T[1][S1] ^ ... ^ T[5][S5]
+ * The Hi-Tag 2 LFSR and crypto_lfsr_simple then hold
+ * (State >> 8) | (Feedback << 40).
+ * crypto_lfsr_shift shifts each byte of its array on its own (the carry
+ * is dropped when stored back into a uint8_t), so after 8 steps only
+ * the feedback remains: State = Feedback << 40.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Reference step function
+typedef uint64_t (*step_fn_t)(uint64_t state);
+
+/*
+ * One step of the Hi-Tag 2 LFSR (reference, as published)
+ */
+static uint64_t hitag2_step(uint64_t x) {
+    uint64_t feedback = (x >> 0) ^ (x >> 2) ^ (x >> 3) ^ (x >> 6) ^
+                        (x >> 7) ^ (x >> 8) ^ (x >> 16) ^ (x >> 22) ^
+                        (x >> 23) ^ (x >> 26) ^ (x >> 30) ^ (x >> 41) ^
+                        (x >> 42) ^ (x >> 43) ^ (x >> 46) ^ (x >> 47);
+
+    return (x >> 1) | ((feedback & 1) << 47);
+}
+
+/*
+ * One step of crypto_lfsr_shift (reference, byte-array form)
+ */
+static uint64_t shift_step(uint64_t value) {
+    uint8_t state[6];
+
+    for (int j = 0; j < 6; j++) {
+        state[j] = (value >> (8 * j)) & 0xFF;
+    }
+
+    uint16_t carry = 0;
+    for (int j = 0; j < 6; j++) {
+        uint16_t new_carry = (state[j] & 1) << 8;
+        state[j] = (state[j] >> 1) | carry;
+        carry = new_carry;
+    }
+
+    uint8_t feedback = 0;
+    if (state[4] & 0x10) feedback ^= 1;  // Bit 36
+    if (state[4] & 0x08) feedback ^= 1;  // Bit 35
+    if (state[3] & 0x80) feedback ^= 1;  // Bit 31
+    if (state[2] & 0x20) feedback ^= 1;  // Bit 21
+    if (state[1] & 0x10) feedback ^= 1;  // Bit 12
+    if (feedback) {
+        state[5] |= 0x80;
+    }
+
+    value = 0;
+    for (int j = 0; j < 6; j++) {
+        value |= (uint64_t)state[j] << (8 * j);
+    }
+    return value;
+}
+
+/*
+ * One step of crypto_lfsr_simple (reference)
+ */
+static uint64_t simple_step(uint64_t state) {
+    state >>= 1;
+    uint64_t feedback = 0;
+
+    if (state & (1ULL << 44)) feedback ^= 1;  // Tap at bit 44
+    if (state & (1ULL << 31)) feedback ^= 1;  // Tap at bit 31
+    if (state & (1ULL << 21)) feedback ^= 1;  // Tap at bit 21
+    if (state & (1ULL << 1)) feedback ^= 1;   // Tap at bit 1
+
+    if (feedback) {
+        state |= (1ULL << 47);
+    }
+    return state;
+}
+
+/*
+ * Pre-shift tap mask of a linear step: bit N is set when State[N]
+ * alone produces feedback into State[47]
+ */
+static uint64_t probe_taps(step_fn_t step) {
+    uint64_t taps = 0;
+
+    for (int b = 0; b < 48; b++) {
+        if ((step(1ULL << b) >> 47) & 1) {
+            taps |= 1ULL << b;
+        }
+    }
+    return taps;
+}
+
+/*
+ * Emit the six per-byte feedback tables of a linear LFSR
+ */
+static void emit_linear_table(const char* name, step_fn_t step) {
+    printf("static const uint8_t %s[6][256] = {\n", name);
+
+    for (int j = 0; j < 6; j++) {
+        printf("    {");
+        for (int b = 0; b < 256; b++) {
+            uint64_t state = (uint64_t)b << (8 * j);
+            for (int i = 0; i < 8; i++) {
+                state = step(state);
+            }
+            printf("%s0x%02X", (b == 0) ? "\n        " : (b % 16) ? ", " : ",\n        ",
+                   (unsigned)((state >> 40) & 0xFF));
+        }
+        printf("\n    }%s\n", (j < 5) ? "," : "");
+    }
+
+    printf("};\n\n");
+}
+
+int main(void) {
+    printf("/*\n");
+    printf(" * Hi-Tag 2 Emulator - Crypto Byte-Stepping Tables\n");
+    printf(" * Generated by tools/gen_crypto_tables.c - do not edit\n");
+    printf(" */\n\n");
+    printf("#ifndef CRYPTO_TABLES_H\n");
+    printf("#define CRYPTO_TABLES_H\n\n");
+    printf("#include <stdint.h>\n\n");
+
+    printf("// Pre-shift tap masks (used for steps shorter than a byte)\n");
+    printf("#define CRYPTO_TAPS_HITAG2  0x%012llXULL\n", (unsigned long long)probe_taps(hitag2_step));
+    printf("#define CRYPTO_TAPS_SHIFT   0x%012llXULL\n", (unsigned long long)probe_taps(shift_step));
+    printf("#define CRYPTO_TAPS_SIMPLE  0x%012llXULL\n\n", (unsigned long long)probe_taps(simple_step));
+
+    printf("// Hi-Tag 2 LFSR: feedback byte contributed by each state byte\n");
+    emit_linear_table("g_hitag2_lfsr_table", hitag2_step);
+
+    printf("// crypto_lfsr_shift: feedback byte contributed by each state byte\n");
+    emit_linear_table("g_lfsr_shift_table", shift_step);
+
+    printf("// crypto_lfsr_simple: feedback byte contributed by each state byte\n");
+    emit_linear_table("g_lfsr_simple_table", simple_step);
+
+    printf("#endif // CRYPTO_TABLES_H\n");
+    return 0;
+}
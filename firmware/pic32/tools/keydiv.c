@@ -0,0 +1,305 @@
+/*
+ * Hi-Tag 2 Emulator - Key Diversification
+ * Batch key derivation for site provisioning (see keydiv.h)
+ */
+
+#include <string.h>
+
+#include "keydiv.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KEYDIV_HAVE_AESNI
+#include <immintrin.h>
+#endif
+
+// Blocks interleaved per AES-NI pass (hides the aesenc latency)
+#define KEYDIV_AES_LANES    8
+
+static const uint8_t g_aes_sbox[256] = {
+    0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5, 0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
+    0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0, 0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0,
+    0xB7, 0xFD, 0x93, 0x26, 0x36, 0x3F, 0xF7, 0xCC, 0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+    0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A, 0x07, 0x12, 0x80, 0xE2, 0xEB, 0x27, 0xB2, 0x75,
+    0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0, 0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84,
+    0x53, 0xD1, 0x00, 0xED, 0x20, 0xFC, 0xB1, 0x5B, 0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+    0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85, 0x45, 0xF9, 0x02, 0x7F, 0x50, 0x3C, 0x9F, 0xA8,
+    0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5, 0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2,
+    0xCD, 0x0C, 0x13, 0xEC, 0x5F, 0x97, 0x44, 0x17, 0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+    0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88, 0x46, 0xEE, 0xB8, 0x14, 0xDE, 0x5E, 0x0B, 0xDB,
+    0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C, 0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79,
+    0xE7, 0xC8, 0x37, 0x6D, 0x8D, 0xD5, 0x4E, 0xA9, 0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+    0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6, 0xE8, 0xDD, 0x74, 0x1F, 0x4B, 0xBD, 0x8B, 0x8A,
+    0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E, 0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E,
+    0xE1, 0xF8, 0x98, 0x11, 0x69, 0xD9, 0x8E, 0x94, 0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+    0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16,
+};
+
+static const char* const g_scheme_names[KEYDIV_SCHEME_COUNT] = {"xor", "aes"};
+
+// AES implementation in use: -1 not chosen yet, 0 portable, 1 AES-NI
+static int g_use_aesni = -1;
+
+/*
+ * Multiply by x in GF(2^8)
+ */
+static inline uint8_t aes_xtime(uint8_t a) {
+    return (uint8_t)((a << 1) ^ ((a & 0x80) ? 0x1B : 0x00));
+}
+
+/*
+ * AES-128 key expansion (FIPS-197 5.2)
+ */
+static void aes_expand_key(uint8_t* rk, const uint8_t* key) {
+    uint8_t rcon = 0x01;
+
+    memcpy(rk, key, 16);
+    for (int i = 16; i < 176; i += 4) {
+        uint8_t t[4] = {rk[i - 4], rk[i - 3], rk[i - 2], rk[i - 1]};
+
+        if (i % 16 == 0) {
+            uint8_t first = t[0];
+            t[0] = g_aes_sbox[t[1]] ^ rcon;
+            t[1] = g_aes_sbox[t[2]];
+            t[2] = g_aes_sbox[t[3]];
+            t[3] = g_aes_sbox[first];
+            rcon = aes_xtime(rcon);
+        }
+        for (int j = 0; j < 4; j++) {
+            rk[i + j] = rk[i - 16 + j] ^ t[j];
+        }
+    }
+}
+
+/*
+ * Encrypt one block with the portable byte-oriented cipher
+ */
+static void aes_encrypt_portable(const uint8_t* rk, const uint8_t* in, uint8_t* out) {
+    uint8_t s[16];
+
+    for (int i = 0; i < 16; i++) {
+        s[i] = in[i] ^ rk[i];
+    }
+
+    for (int round = 1; round <= 10; round++) {
+        uint8_t t[16];
+
+        // SubBytes and ShiftRows (column-major state)
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) {
+                t[4 * c + r] = g_aes_sbox[s[4 * ((c + r) & 3) + r]];
+            }
+        }
+
+        // MixColumns (not in the last round)
+        if (round < 10) {
+            for (int c = 0; c < 4; c++) {
+                uint8_t* col = &t[4 * c];
+                uint8_t all = col[0] ^ col[1] ^ col[2] ^ col[3];
+                uint8_t first = col[0];
+                col[0] ^= all ^ aes_xtime(col[0] ^ col[1]);
+                col[1] ^= all ^ aes_xtime(col[1] ^ col[2]);
+                col[2] ^= all ^ aes_xtime(col[2] ^ col[3]);
+                col[3] ^= all ^ aes_xtime(col[3] ^ first);
+            }
+        }
+
+        for (int i = 0; i < 16; i++) {
+            s[i] = t[i] ^ rk[16 * round + i];
+        }
+    }
+
+    memcpy(out, s, 16);
+}
+
+#ifdef KEYDIV_HAVE_AESNI
+
+/*
+ * Encrypt up to KEYDIV_AES_LANES blocks with AES-NI, rounds interleaved
+ */
+__attribute__((target("aes,sse2")))
+static void aes_encrypt_aesni(const uint8_t* rk, const uint8_t* in, uint8_t* out, uint32_t n) {
+    __m128i b[KEYDIV_AES_LANES];
+    __m128i k = _mm_loadu_si128((const __m128i*)rk);
+
+    for (uint32_t i = 0; i < n; i++) {
+        b[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + 16 * i)), k);
+    }
+    for (int round = 1; round < 10; round++) {
+        k = _mm_loadu_si128((const __m128i*)(rk + 16 * round));
+        for (uint32_t i = 0; i < n; i++) {
+            b[i] = _mm_aesenc_si128(b[i], k);
+        }
+    }
+    k = _mm_loadu_si128((const __m128i*)(rk + 160));
+    for (uint32_t i = 0; i < n; i++) {
+        _mm_storeu_si128((__m128i*)(out + 16 * i), _mm_aesenclast_si128(b[i], k));
+    }
+}
+
+#endif // KEYDIV_HAVE_AESNI
+
+/*
+ * Encrypt n blocks with the implementation picked for this CPU
+ */
+static void aes_encrypt_blocks(const uint8_t* rk, const uint8_t* in, uint8_t* out, uint32_t n) {
+    keydiv_aes_impl();
+
+#ifdef KEYDIV_HAVE_AESNI
+    if (g_use_aesni) {
+        for (uint32_t i = 0; i < n; i += KEYDIV_AES_LANES) {
+            uint32_t lanes = (n - i < KEYDIV_AES_LANES) ? n - i : KEYDIV_AES_LANES;
+            aes_encrypt_aesni(rk, in + 16 * i, out + 16 * i, lanes);
+        }
+        return;
+    }
+#endif
+
+    for (uint32_t i = 0; i < n; i++) {
+        aes_encrypt_portable(rk, in + 16 * i, out + 16 * i);
+    }
+}
+
+/*
+ * Get the name of the AES implementation, choosing it on first use
+ */
+const char* keydiv_aes_impl(void) {
+    if (g_use_aesni < 0) {
+        g_use_aesni = 0;
+#ifdef KEYDIV_HAVE_AESNI
+        __builtin_cpu_init();
+        g_use_aesni = __builtin_cpu_supports("aes") ? 1 : 0;
+#endif
+    }
+    return g_use_aesni ? "aes-ni" : "portable";
+}
+
+/*
+ * Get the master secret length of a scheme
+ */
+size_t keydiv_master_len(keydiv_scheme_t scheme) {
+    return (scheme == KEYDIV_AES) ? 16 : 6;
+}
+
+/*
+ * Get the printable name of a scheme
+ */
+const char* keydiv_scheme_name(keydiv_scheme_t scheme) {
+    return (scheme < KEYDIV_SCHEME_COUNT) ? g_scheme_names[scheme] : "none";
+}
+
+/*
+ * Look a scheme up by name
+ */
+bool keydiv_parse_scheme(const char* name, keydiv_scheme_t* scheme) {
+    for (int i = 0; i < KEYDIV_SCHEME_COUNT; i++) {
+        if (strcmp(name, g_scheme_names[i]) == 0) {
+            *scheme = (keydiv_scheme_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Prepare a master secret
+ * returns: false if the length does not fit the scheme
+ */
+bool keydiv_init(keydiv_ctx_t* ctx, keydiv_scheme_t scheme, const uint8_t* master,
+                 size_t len, uint32_t site) {
+    if (scheme >= KEYDIV_SCHEME_COUNT || len != keydiv_master_len(scheme)) {
+        return false;
+    }
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->scheme = scheme;
+    ctx->site = site;
+
+    if (scheme == KEYDIV_AES) {
+        aes_expand_key(ctx->round_keys, master);
+    } else {
+        for (int j = 0; j < 6; j++) {
+            ctx->master |= (uint64_t)master[j] << (8 * j);
+        }
+    }
+    return true;
+}
+
+/*
+ * Derive the keys of count UIDs
+ */
+void keydiv_derive(const keydiv_ctx_t* ctx, const uint32_t* uids, hitag2_key_t* keys,
+                   uint32_t count) {
+    if (ctx->scheme == KEYDIV_XOR) {
+        for (uint32_t i = 0; i < count; i++) {
+            uint64_t key = ctx->master ^ uids[i];
+            for (int j = 0; j < 6; j++) {
+                keys[i].bytes[j] = (key >> (8 * j)) & 0xFF;
+            }
+        }
+        return;
+    }
+
+    uint8_t in[16 * 64], out[16 * 64];
+    memset(in, 0, sizeof(in));
+
+    for (uint32_t base = 0; base < count; base += 64) {
+        uint32_t n = (count - base < 64) ? count - base : 64;
+
+        for (uint32_t i = 0; i < n; i++) {
+            uint8_t* block = &in[16 * i];
+            for (int j = 0; j < 4; j++) {
+                block[j] = (uids[base + i] >> (8 * j)) & 0xFF;
+                block[4 + j] = (ctx->site >> (8 * j)) & 0xFF;
+            }
+        }
+
+        aes_encrypt_blocks(ctx->round_keys, in, out, n);
+
+        for (uint32_t i = 0; i < n; i++) {
+            memcpy(keys[base + i].bytes, &out[16 * i], 6);
+        }
+    }
+}
+
+/*
+ * Build the token image of one UID and key (page layout of memory.c)
+ */
+void keydiv_token_image(uint8_t* image, uint32_t uid, uint32_t config,
+                        const hitag2_key_t* key, uint16_t password) {
+    memset(image, 0, KEYDIV_TOKEN_SIZE);
+
+    for (int j = 0; j < 4; j++) {
+        image[0 + j] = (uid >> (8 * j)) & 0xFF;      // Page 0: UID
+        image[4 + j] = (config >> (8 * j)) & 0xFF;   // Page 1: Configuration
+        image[8 + j] = key->bytes[j];                 // Page 2: Key bits 0-31
+    }
+    image[12] = password & 0xFF;                      // Page 3: password,
+    image[13] = (password >> 8) & 0xFF;               // key bits 32-47
+    image[14] = key->bytes[4];
+    image[15] = key->bytes[5];
+}
+
+/*
+ * Check both AES implementations against FIPS-197 appendix C.1
+ */
+bool keydiv_self_test(void) {
+    static const uint8_t expect[16] = {
+        0x69, 0xC4, 0xE0, 0xD8, 0x6A, 0x7B, 0x04, 0x30,
+        0xD8, 0xCD, 0xB7, 0x80, 0x70, 0xB4, 0xC5, 0x5A,
+    };
+    uint8_t key[16], in[16], rk[176], out[16];
+
+    for (int i = 0; i < 16; i++) {
+        key[i] = i;
+        in[i] = (uint8_t)(i * 0x11);
+    }
+    aes_expand_key(rk, key);
+
+    aes_encrypt_portable(rk, in, out);
+    if (memcmp(out, expect, 16) != 0) {
+        return false;
+    }
+
+    aes_encrypt_blocks(rk, in, out, 1);
+    return memcmp(out, expect, 16) == 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * Hi-Tag 2 Emulator - Key Diversification
+ * Derives per-token keys from a master secret for site provisioning
+ *
+ * Schemes (research/HITAG2_Protocol_Research.md, "Key Diversification"):
+ *   xor: Key = Master[47:0] XOR UID
+ *   aes: Key = AES-128_Encrypt(Master, UID | Site << 32)[47:0]
+ * The AES block is UID and site code as little-endian words followed by
+ * 8 zero bytes; the key is the first 6 ciphertext bytes (key[0] first).
+ *
+ * Keys are derived in batches: AES runs 8 blocks interleaved through
+ * AES-NI when the CPU has it (picked at runtime), else a portable
+ * implementation; xor is a plain loop the compiler vectorizes.
+ *
+ * Token images are the 32-byte page dump memory_load_token() takes
+ * (LOAD_TOKEN): 8 pages, little-endian, key in page 2 and the upper
+ * half of page 3, password in the lower half of page 3.
+ */
+
+#ifndef KEYDIV_H
+#define KEYDIV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "crypto.h"
+
+#define KEYDIV_TOKEN_SIZE   32
+#define KEYDIV_MAX_MASTER   16
+
+typedef enum {
+    KEYDIV_XOR = 0,
+    KEYDIV_AES,
+    KEYDIV_SCHEME_COUNT
+} keydiv_scheme_t;
+
+// Master secret prepared for one scheme
+typedef struct {
+    keydiv_scheme_t scheme;
+    uint32_t site;                  // Site code (aes)
+    uint64_t master;                // Master[47:0] (xor)
+    uint8_t round_keys[176];        // AES-128 key schedule (aes)
+} keydiv_ctx_t;
+
+// Master secret length in bytes for a scheme (6 for xor, 16 for aes)
+size_t keydiv_master_len(keydiv_scheme_t scheme);
+const char* keydiv_scheme_name(keydiv_scheme_t scheme);
+bool keydiv_parse_scheme(const char* name, keydiv_scheme_t* scheme);
+
+// Prepare a master secret (keydiv_master_len() bytes)
+bool keydiv_init(keydiv_ctx_t* ctx, keydiv_scheme_t scheme, const uint8_t* master,
+                 size_t len, uint32_t site);
+
+// Derive the keys of count UIDs
+void keydiv_derive(const keydiv_ctx_t* ctx, const uint32_t* uids, hitag2_key_t* keys,
+                   uint32_t count);
+
+// Build the token image of one UID and key
+void keydiv_token_image(uint8_t* image, uint32_t uid, uint32_t config,
+                        const hitag2_key_t* key, uint16_t password);
+
+// Name of the AES implementation in use ("aes-ni" or "portable")
+const char* keydiv_aes_impl(void);
+
+// Check both AES implementations against the FIPS-197 vector
+bool keydiv_self_test(void);
+
+#endif // KEYDIV_H
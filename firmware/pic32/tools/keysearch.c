@@ -0,0 +1,1241 @@
+/*
+ * Hi-Tag 2 Emulator - Offline Key Search Tool
+ * Recovers the 48-bit key of a token from captured authentications
+ *
+ * Usage: keysearch [options] UID:CHALLENGE:RESPONSE [UID:CHALLENGE:RESPONSE ...]
+ *   -t N       worker threads (default: all cores)
+ *   -s KEY     first key of the search range (hex, default 0)
+ *   -e KEY     end of the search range, exclusive (hex, default 2^48)
+ *   -c FILE    checkpoint file; resumed from if it exists
+ *   -i SEC     checkpoint interval in seconds (default 60)
+ *   -a         report every matching key instead of stopping at the first
+ *   -L FILE    shard ledger shared with other keysearch processes (see below)
+ *   -S BITS    log2 of the keys per shard when creating a ledger (default 32)
+ *   -p         print the ledger status and exit
+ *
+ * Values are hex as seen by the firmware: the key is printed as the
+ * 48-bit value with key[0] in the low byte.
+ *
+ * Every key is tested against the first tuple with the fastest batch
+ * kernel on this CPU; only candidates that match are checked against
+ * the remaining tuples. Two tuples are needed to rule out the ~2^16
+ * false positives a 32-bit response leaves over 2^48 keys.
+ *
+ * Scheduling: the key range is split evenly between the workers. Each
+ * worker takes blocks from the front of its own range; when it runs
+ * dry it steals the back half of the largest remaining range. The
+ * checkpoint records every unfinished range (including blocks being
+ * searched) so an interrupted search resumes without gaps; adjacent
+ * ranges are merged on every write and read, so the file stays about as
+ * small as the gaps in the searched space allow.
+ *
+ * Ledger mode (-L) spreads one search over any number of processes on
+ * one machine or several with no coordinator. The key range is cut into
+ * fixed shards of 2^BITS keys and the ledger file holds one 64-byte
+ * record per shard; every process mmaps it shared and its threads claim
+ * shards with compare-and-swap on the record's claim word:
+ *   0            free
+ *   LEDGER_DONE  searched
+ *   otherwise    claimed: lease expiry (unix seconds) << 24 | owner tag
+ * An owner renews its lease while it searches and records how far into
+ * the shard it got after every block. A claim whose lease has expired
+ * (the owner crashed) is taken over by CAS and resumed from that point,
+ * so no finished shard or block is searched twice. Keys found and the
+ * keys/time spent per shard (throughput) are written back to the ledger.
+ * The first process creates the ledger from its tuples and range; later
+ * ones join with just -L. Sharing across machines needs a filesystem
+ * that keeps shared mappings coherent between hosts (plain NFS does not;
+ * there, give each machine its own ledger and -s/-e range).
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "crypto.h"
+
+#define KEY_SPACE       (1ULL << 48)
+#define BLOCK_KEYS      (1ULL << 16)   // Keys per scheduling block
+#define BATCH_KEYS      4096           // Keys per batch kernel call
+#define MAX_TUPLES      8
+#define MAX_THREADS     256
+#define MAX_FOUND       64
+
+// Shard ledger
+#define LEDGER_MAGIC        "HT2LEDG"
+#define LEDGER_VERSION      1
+#define LEDGER_SHARDS_AT    4096           // File offset of the shard records
+#define LEDGER_MAX_SHARDS   (1U << 24)
+#define LEDGER_LEASE        120            // Seconds a claim lives without renewal
+#define LEDGER_DONE         UINT64_MAX     // Claim word of a searched shard
+#define LEDGER_FOUND_VALID  (1ULL << 63)   // Marks a written found[] slot
+
+// Captured authentication
+typedef struct {
+    uint32_t uid;
+    uint32_t challenge;
+    uint32_t response;
+} tuple_t;
+
+// Ledger file header
+// Counters and claim words are only accessed with atomics
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_tuples;
+    tuple_t tuples[MAX_TUPLES];
+    uint64_t start;                 // Key range [start, end)
+    uint64_t end;
+    uint32_t shard_bits;            // Keys per shard: 2^shard_bits
+    uint32_t num_shards;
+    uint32_t next_shard;            // First never-claimed shard
+    uint32_t shards_done;
+    uint32_t stop;                  // Set when a key is found (unless -a)
+    uint32_t num_found;             // found[] slots taken
+    uint64_t found[MAX_FOUND];      // Key | LEDGER_FOUND_VALID
+} ledger_header_t;
+
+_Static_assert(sizeof(ledger_header_t) <= LEDGER_SHARDS_AT, "ledger header too large");
+
+// Ledger record of one shard (64 bytes)
+typedef struct {
+    uint64_t claim;                 // 0, LEDGER_DONE or a lease
+    uint64_t searched;              // Keys searched from the front of the shard
+    uint64_t keys;                  // Keys searched by all owners
+    uint64_t ns;                    // Time they took (throughput = keys / ns)
+    uint64_t finished;              // Unix time of completion
+    uint32_t host;                  // Last owner: host name hash and PID
+    uint32_t pid;
+    uint64_t reserved[2];
+} ledger_shard_t;
+
+// Key range [next, end)
+typedef struct {
+    uint64_t next;
+    uint64_t end;
+} range_t;
+
+// Per-worker state
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    range_t range;          // Unclaimed keys
+    range_t block;          // Block being searched (empty if none)
+} worker_t;
+
+static tuple_t g_tuples[MAX_TUPLES];
+static int g_num_tuples = 0;
+
+static worker_t g_workers[MAX_THREADS];
+static int g_num_workers = 0;
+
+// Ranges not yet handed to a worker (extra pieces of a checkpoint)
+static pthread_mutex_t g_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static range_t* g_pool = NULL;
+static int g_pool_size = 0;
+static int g_pool_capacity = 0;
+
+static pthread_mutex_t g_found_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t g_found[MAX_FOUND];
+static int g_num_found = 0;
+static bool g_find_all = false;
+
+static volatile sig_atomic_t g_stop = 0;
+static uint64_t g_keys_done = 0;        // Updated atomically
+
+static ledger_header_t* g_ledger = NULL;
+static ledger_shard_t* g_shards = NULL;
+static size_t g_ledger_size = 0;
+static uint32_t g_host = 0;             // Host name hash (FNV-1a)
+static uint32_t g_active = 0;           // Ledger workers still running
+
+/*
+ * Parse a hex number, rejecting trailing garbage
+ */
+static bool parse_hex(const char* text, uint64_t* value) {
+    char* end;
+
+    errno = 0;
+    *value = strtoull(text, &end, 16);
+    return errno == 0 && end != text && *end == '\0';
+}
+
+/*
+ * Parse UID:CHALLENGE:RESPONSE
+ */
+static bool parse_tuple(const char* text, tuple_t* tuple) {
+    unsigned int uid, challenge, response;
+    char extra;
+
+    if (sscanf(text, "%x:%x:%x%c", &uid, &challenge, &response, &extra) != 3) {
+        return false;
+    }
+
+    tuple->uid = uid;
+    tuple->challenge = challenge;
+    tuple->response = response;
+    return true;
+}
+
+/*
+ * Unpack a 48-bit key value into the firmware's byte order
+ */
+static void key_unpack(uint64_t value, uint8_t* key) {
+    for (int j = 0; j < 6; j++) {
+        key[j] = (value >> (8 * j)) & 0xFF;
+    }
+}
+
+/*
+ * Check a candidate against every tuple after the first
+ */
+static bool key_confirm(uint64_t value) {
+    uint8_t key[6];
+    key_unpack(value, key);
+
+    for (int t = 1; t < g_num_tuples; t++) {
+        if (!crypto_verify_response(key, g_tuples[t].uid, g_tuples[t].challenge,
+                                    g_tuples[t].response)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Check whether a key is already recorded, here or in the ledger
+ * A shard taken over after its owner died is searched again from the
+ * last block the owner stored, so a key it found can turn up twice.
+ */
+static bool key_known(uint64_t value) {
+    for (int i = 0; i < g_num_found; i++) {
+        if (g_found[i] == value) {
+            return true;
+        }
+    }
+    if (g_ledger) {
+        for (int i = 0; i < MAX_FOUND; i++) {
+            uint64_t v = __atomic_load_n(&g_ledger->found[i], __ATOMIC_ACQUIRE);
+            if (v == (value | LEDGER_FOUND_VALID)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/*
+ * Record a confirmed key (once)
+ */
+static void key_found(uint64_t value) {
+    pthread_mutex_lock(&g_found_lock);
+
+    if (!key_known(value)) {
+        if (g_num_found < MAX_FOUND) {
+            g_found[g_num_found++] = value;
+        }
+        printf("KEY FOUND: %012" PRIX64 "\n", value);
+        fflush(stdout);
+
+        if (g_ledger) {
+            uint32_t slot = __atomic_fetch_add(&g_ledger->num_found, 1, __ATOMIC_RELAXED);
+            if (slot < MAX_FOUND) {
+                __atomic_store_n(&g_ledger->found[slot], value | LEDGER_FOUND_VALID,
+                                 __ATOMIC_RELEASE);
+            }
+        }
+    }
+
+    if (!g_find_all) {
+        g_stop = 1;
+        if (g_ledger) {
+            __atomic_store_n(&g_ledger->stop, 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    pthread_mutex_unlock(&g_found_lock);
+}
+
+/*
+ * Claim the next block of a worker's own range
+ */
+static bool worker_take(worker_t* w, range_t* block) {
+    bool ok = false;
+
+    pthread_mutex_lock(&w->lock);
+    if (w->range.next < w->range.end) {
+        uint64_t n = w->range.end - w->range.next;
+        block->next = w->range.next;
+        block->end = block->next + ((n < BLOCK_KEYS) ? n : BLOCK_KEYS);
+        w->range.next = block->end;
+        w->block = *block;
+        ok = true;
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    return ok;
+}
+
+/*
+ * Refill an empty worker from the pool
+ */
+static bool worker_refill(worker_t* self) {
+    bool ok = false;
+
+    pthread_mutex_lock(&g_pool_lock);
+    if (g_pool_size > 0) {
+        pthread_mutex_lock(&self->lock);
+        self->range = g_pool[--g_pool_size];
+        pthread_mutex_unlock(&self->lock);
+        ok = true;
+    }
+    pthread_mutex_unlock(&g_pool_lock);
+
+    return ok;
+}
+
+/*
+ * Steal the back half of the largest remaining range
+ */
+static bool worker_steal(worker_t* self) {
+    for (;;) {
+        worker_t* victim = NULL;
+        uint64_t largest = 0;
+
+        // Racy scan is fine: the split below re-checks under the lock
+        for (int i = 0; i < g_num_workers; i++) {
+            worker_t* w = &g_workers[i];
+            uint64_t n = w->range.end - w->range.next;
+            if (w != self && w->range.next < w->range.end && n > largest) {
+                largest = n;
+                victim = w;
+            }
+        }
+
+        if (!victim) {
+            return false;
+        }
+
+        bool ok = false;
+        pthread_mutex_lock(&victim->lock);
+        if (victim->range.next < victim->range.end) {
+            uint64_t n = victim->range.end - victim->range.next;
+            uint64_t mid = victim->range.next + n / 2;
+
+            // Lock order victim -> self cannot deadlock: only empty
+            // workers steal, and an empty range is never a victim
+            pthread_mutex_lock(&self->lock);
+            self->range.next = mid;
+            self->range.end = victim->range.end;
+            pthread_mutex_unlock(&self->lock);
+
+            victim->range.end = mid;
+            ok = true;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (ok) {
+            return true;
+        }
+    }
+}
+
+/*
+ * Search one block against the first tuple
+ */
+static void search_block(range_t block, hitag2_key_t* keys, uint32_t* uids,
+                         uint32_t* challenges, uint32_t* responses) {
+    const uint32_t target = g_tuples[0].response;
+
+    for (uint64_t base = block.next; base < block.end && !g_stop; base += BATCH_KEYS) {
+        uint32_t count = (block.end - base < BATCH_KEYS) ?
+                         (uint32_t)(block.end - base) : BATCH_KEYS;
+
+        for (uint32_t i = 0; i < count; i++) {
+            key_unpack(base + i, keys[i].bytes);
+        }
+
+        crypto_compute_response_batch(keys, uids, challenges, responses, count);
+
+        for (uint32_t i = 0; i < count; i++) {
+            if (responses[i] == target && key_confirm(base + i)) {
+                key_found(base + i);
+            }
+        }
+    }
+}
+
+/*
+ * Check whether this process or another ledger user has stopped
+ */
+static bool search_stopped(void) {
+    return g_stop || (g_ledger && __atomic_load_n(&g_ledger->stop, __ATOMIC_ACQUIRE));
+}
+
+/*
+ * Build a lease word: expiry time and an owner tag unique per thread
+ */
+static uint64_t ledger_lease(uint32_t tag) {
+    return ((uint64_t)time(NULL) + LEDGER_LEASE) << 24 | (tag & 0xFFFFFF);
+}
+
+/*
+ * Check whether a claim word is a lease that has run out
+ */
+static bool ledger_stale(uint64_t claim) {
+    return claim != 0 && claim != LEDGER_DONE && (claim >> 24) < (uint64_t)time(NULL);
+}
+
+/*
+ * Claim a shard: a never-claimed one first, then one released or left
+ * behind by a crashed owner
+ * Waits while the only unfinished shards are held by live owners, so
+ * survivors pick up a crashed owner's shard once its lease expires.
+ * returns: false when every shard is searched or the search stopped
+ */
+static bool ledger_claim(uint32_t tag, uint32_t* index, uint64_t* lease) {
+    ledger_header_t* h = g_ledger;
+
+    while (!search_stopped()) {
+        uint32_t i = __atomic_fetch_add(&h->next_shard, 1, __ATOMIC_RELAXED);
+        if (i < h->num_shards) {
+            uint64_t expect = 0;
+            *lease = ledger_lease(tag);
+            if (__atomic_compare_exchange_n(&g_shards[i].claim, &expect, *lease, false,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                *index = i;
+                return true;
+            }
+            continue;
+        }
+        __atomic_store_n(&h->next_shard, h->num_shards, __ATOMIC_RELAXED);
+
+        bool pending = false;
+        for (i = 0; i < h->num_shards && !search_stopped(); i++) {
+            uint64_t claim = __atomic_load_n(&g_shards[i].claim, __ATOMIC_ACQUIRE);
+            if (claim == LEDGER_DONE) {
+                continue;
+            }
+            pending = true;
+            if (claim == 0 || ledger_stale(claim)) {
+                *lease = ledger_lease(tag);
+                if (__atomic_compare_exchange_n(&g_shards[i].claim, &claim, *lease, false,
+                                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                    *index = i;
+                    return true;
+                }
+            }
+        }
+        if (!pending) {
+            return false;
+        }
+        sleep(1);
+    }
+    return false;
+}
+
+/*
+ * Renew a lease once half of it has passed
+ * returns: false if another process has taken the shard over
+ */
+static bool ledger_renew(ledger_shard_t* shard, uint32_t tag, uint64_t* lease) {
+    if ((int64_t)(*lease >> 24) - (int64_t)time(NULL) > LEDGER_LEASE / 2) {
+        return __atomic_load_n(&shard->claim, __ATOMIC_ACQUIRE) == *lease;
+    }
+
+    uint64_t expect = *lease;
+    uint64_t renewed = ledger_lease(tag);
+    if (!__atomic_compare_exchange_n(&shard->claim, &expect, renewed, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    *lease = renewed;
+    return true;
+}
+
+/*
+ * Search a claimed shard from where its last owner stopped
+ * Progress and throughput go to the shard record after every block;
+ * a stopped search releases the shard for other processes.
+ */
+static void ledger_search(uint32_t index, uint32_t tag, uint64_t lease, hitag2_key_t* keys,
+                          uint32_t* uids, uint32_t* challenges, uint32_t* responses) {
+    const ledger_header_t* h = g_ledger;
+    ledger_shard_t* shard = &g_shards[index];
+    uint64_t first = h->start + ((uint64_t)index << h->shard_bits);
+    uint64_t size = ((h->end - first) >> h->shard_bits) ? (1ULL << h->shard_bits) : h->end - first;
+    uint64_t searched = __atomic_load_n(&shard->searched, __ATOMIC_ACQUIRE);
+
+    shard->host = g_host;
+    shard->pid = (uint32_t)getpid();
+
+    while (searched < size) {
+        if (search_stopped() || !ledger_renew(shard, tag, &lease)) {
+            break;
+        }
+
+        range_t block;
+        block.next = first + searched;
+        block.end = block.next + ((size - searched < BLOCK_KEYS) ? size - searched : BLOCK_KEYS);
+
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        search_block(block, keys, uids, challenges, responses);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (g_stop) {
+            break;
+        }
+
+        searched += block.end - block.next;
+        __atomic_store_n(&shard->searched, searched, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&shard->keys, block.end - block.next, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&shard->ns, (uint64_t)((t1.tv_sec - t0.tv_sec) * 1000000000LL +
+                                                  (t1.tv_nsec - t0.tv_nsec)), __ATOMIC_RELAXED);
+        __atomic_fetch_add(&g_keys_done, block.end - block.next, __ATOMIC_RELAXED);
+    }
+
+    if (searched >= size) {
+        // The keys are searched even if the lease was lost meanwhile
+        shard->finished = (uint64_t)time(NULL);
+        if (__atomic_exchange_n(&shard->claim, LEDGER_DONE, __ATOMIC_ACQ_REL) != LEDGER_DONE) {
+            __atomic_fetch_add(&g_ledger->shards_done, 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        uint64_t expect = lease;
+        __atomic_compare_exchange_n(&shard->claim, &expect, 0, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    }
+}
+
+/*
+ * Worker loop of ledger mode: claim and search shards until none is left
+ */
+static void ledger_run(uint32_t tag, hitag2_key_t* keys, uint32_t* uids,
+                       uint32_t* challenges, uint32_t* responses) {
+    uint32_t index;
+    uint64_t lease;
+
+    while (ledger_claim(tag, &index, &lease)) {
+        ledger_search(index, tag, lease, keys, uids, challenges, responses);
+    }
+    __atomic_fetch_sub(&g_active, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Worker thread
+ */
+static void* worker_main(void* arg) {
+    worker_t* w = arg;
+    static __thread hitag2_key_t keys[BATCH_KEYS];
+    static __thread uint32_t uids[BATCH_KEYS];
+    static __thread uint32_t challenges[BATCH_KEYS];
+    static __thread uint32_t responses[BATCH_KEYS];
+
+    for (int i = 0; i < BATCH_KEYS; i++) {
+        uids[i] = g_tuples[0].uid;
+        challenges[i] = g_tuples[0].challenge;
+    }
+
+    if (g_ledger) {
+        uint32_t tag = g_host ^ ((uint32_t)getpid() << 8) ^ (uint32_t)(w - g_workers);
+        ledger_run(tag, keys, uids, challenges, responses);
+        return NULL;
+    }
+
+    while (!g_stop) {
+        range_t block;
+
+        if (!worker_take(w, &block)) {
+            if (!worker_refill(w) && !worker_steal(w)) {
+                break;
+            }
+            continue;
+        }
+
+        search_block(block, keys, uids, challenges, responses);
+
+        if (!g_stop) {
+            pthread_mutex_lock(&w->lock);
+            w->block.next = w->block.end = 0;
+            pthread_mutex_unlock(&w->lock);
+            __atomic_fetch_add(&g_keys_done, block.end - block.next, __ATOMIC_RELAXED);
+        }
+    }
+
+    return NULL;
+}
+
+static int compare_ranges(const void* a, const void* b) {
+    const range_t* x = a;
+    const range_t* y = b;
+    return (x->next > y->next) - (x->next < y->next);
+}
+
+/*
+ * Sort ranges, drop empty ones and merge those that touch or overlap
+ * returns: number of ranges left
+ */
+static int merge_ranges(range_t* ranges, int n) {
+    int out = 0;
+
+    qsort(ranges, n, sizeof(range_t), compare_ranges);
+    for (int i = 0; i < n; i++) {
+        if (ranges[i].next >= ranges[i].end) {
+            continue;
+        }
+        if (out > 0 && ranges[i].next <= ranges[out - 1].end) {
+            if (ranges[i].end > ranges[out - 1].end) {
+                ranges[out - 1].end = ranges[i].end;
+            }
+        } else {
+            ranges[out++] = ranges[i];
+        }
+    }
+    return out;
+}
+
+/*
+ * Collect unfinished ranges (unclaimed keys and blocks in progress)
+ * ranges: room for g_pool_capacity + 2 * g_num_workers entries (the pool
+ * only shrinks, each worker adds at most its block and its range)
+ * returns: number of ranges, merged
+ */
+static int collect_ranges(range_t* ranges) {
+    int n = 0;
+
+    pthread_mutex_lock(&g_pool_lock);
+    for (int i = 0; i < g_pool_size; i++) {
+        ranges[n++] = g_pool[i];
+    }
+    pthread_mutex_unlock(&g_pool_lock);
+
+    for (int i = 0; i < g_num_workers; i++) {
+        worker_t* w = &g_workers[i];
+
+        pthread_mutex_lock(&w->lock);
+        if (w->block.next < w->block.end) {
+            ranges[n++] = w->block;
+        }
+        if (w->range.next < w->range.end) {
+            ranges[n++] = w->range;
+        }
+        pthread_mutex_unlock(&w->lock);
+    }
+
+    return merge_ranges(ranges, n);
+}
+
+/*
+ * Write the checkpoint (to a temporary file, then renamed over it)
+ */
+static bool checkpoint_write(const char* path) {
+    range_t* ranges = malloc((g_pool_capacity + 2 * g_num_workers) * sizeof(range_t));
+    char tmp[4096];
+
+    if (!ranges) {
+        fprintf(stderr, "%s: out of memory\n", path);
+        return false;
+    }
+    int n = collect_ranges(ranges);
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* f = fopen(tmp, "w");
+    if (!f) {
+        perror(tmp);
+        free(ranges);
+        return false;
+    }
+
+    fprintf(f, "# Hi-Tag 2 keysearch checkpoint\n");
+    for (int t = 0; t < g_num_tuples; t++) {
+        fprintf(f, "tuple %08" PRIX32 ":%08" PRIX32 ":%08" PRIX32 "\n",
+                g_tuples[t].uid, g_tuples[t].challenge, g_tuples[t].response);
+    }
+    for (int i = 0; i < n; i++) {
+        fprintf(f, "range %012" PRIX64 " %012" PRIX64 "\n", ranges[i].next, ranges[i].end);
+    }
+    free(ranges);
+    pthread_mutex_lock(&g_found_lock);
+    for (int i = 0; i < g_num_found; i++) {
+        fprintf(f, "found %012" PRIX64 "\n", g_found[i]);
+    }
+    pthread_mutex_unlock(&g_found_lock);
+
+    bool ok = (fflush(f) == 0) && (fsync(fileno(f)) == 0);
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        perror(path);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Read a checkpoint
+ * ranges: set to a malloc'd array of the ranges, merged
+ * returns: number of ranges, or -1 if the file does not exist / is bad
+ */
+static int checkpoint_read(const char* path, range_t** ranges_out) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+
+    char line[256];
+    range_t* ranges = NULL;
+    int n = 0;
+    int capacity = 0;
+    int num_tuples = 0;
+    bool ok = true;
+
+    while (ok && fgets(line, sizeof(line), f)) {
+        char arg1[64], arg2[64];
+        tuple_t tuple;
+
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#' || line[0] == '\0') {
+            continue;
+        }
+
+        if (sscanf(line, "tuple %63s", arg1) == 1) {
+            ok = parse_tuple(arg1, &tuple) && num_tuples < MAX_TUPLES;
+            if (ok && num_tuples < g_num_tuples) {
+                ok = memcmp(&tuple, &g_tuples[num_tuples], sizeof(tuple)) == 0;
+                if (!ok) {
+                    fprintf(stderr, "%s: tuples differ from the command line\n", path);
+                }
+            } else if (ok) {
+                g_tuples[num_tuples] = tuple;
+            }
+            num_tuples++;
+        } else if (sscanf(line, "range %63s %63s", arg1, arg2) == 2) {
+            if (n == capacity) {
+                capacity = capacity ? 2 * capacity : 64;
+                ranges = realloc(ranges, capacity * sizeof(range_t));
+                if (!ranges) {
+                    fprintf(stderr, "%s: out of memory\n", path);
+                    exit(1);
+                }
+            }
+            ok = parse_hex(arg1, &ranges[n].next) && parse_hex(arg2, &ranges[n].end);
+            n++;
+        } else if (sscanf(line, "found %63s", arg1) == 1) {
+            uint64_t key;
+            ok = parse_hex(arg1, &key);
+            if (ok && g_num_found < MAX_FOUND) {
+                g_found[g_num_found++] = key;
+            }
+        } else {
+            ok = false;
+        }
+    }
+    fclose(f);
+
+    if (!ok || num_tuples == 0) {
+        fprintf(stderr, "%s: invalid checkpoint\n", path);
+        exit(1);
+    }
+    g_num_tuples = num_tuples;
+    *ranges_out = ranges;
+    return merge_ranges(ranges, n);
+}
+
+/*
+ * Hash the host name (FNV-1a), to tell ledger owners apart
+ */
+static uint32_t host_hash(void) {
+    char name[256] = "";
+    uint32_t h = 2166136261U;
+
+    gethostname(name, sizeof(name) - 1);
+    for (const char* c = name; *c; c++) {
+        h = (h ^ (uint8_t)*c) * 16777619U;
+    }
+    return h;
+}
+
+/*
+ * Create a ledger for the command line tuples and range
+ * Written to a private file and linked into place, so a concurrent
+ * process either sees no ledger or a complete one.
+ * returns: false if another process created it first
+ */
+static bool ledger_create(const char* path, uint64_t start, uint64_t end, uint32_t shard_bits) {
+    uint64_t shards = ((end - start) + (1ULL << shard_bits) - 1) >> shard_bits;
+    char tmp[4096];
+
+    if (shards > LEDGER_MAX_SHARDS) {
+        fprintf(stderr, "%s: %" PRIu64 " shards, at most %u (raise -S)\n", path, shards,
+                LEDGER_MAX_SHARDS);
+        exit(1);
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.%u.tmp", path, (unsigned)getpid());
+    FILE* f = fopen(tmp, "w");
+    if (!f) {
+        perror(tmp);
+        exit(1);
+    }
+
+    ledger_header_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, LEDGER_MAGIC, sizeof(h.magic));
+    h.version = LEDGER_VERSION;
+    h.num_tuples = g_num_tuples;
+    memcpy(h.tuples, g_tuples, sizeof(h.tuples));
+    h.start = start;
+    h.end = end;
+    h.shard_bits = shard_bits;
+    h.num_shards = (uint32_t)shards;
+
+    size_t size = LEDGER_SHARDS_AT + shards * sizeof(ledger_shard_t);
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 && ftruncate(fileno(f), size) == 0 &&
+              fflush(f) == 0 && fsync(fileno(f)) == 0;
+    ok = (fclose(f) == 0) && ok;
+    if (!ok) {
+        perror(tmp);
+        unlink(tmp);
+        exit(1);
+    }
+
+    bool created = link(tmp, path) == 0;
+    if (!created && errno != EEXIST) {
+        perror(path);
+        unlink(tmp);
+        exit(1);
+    }
+    unlink(tmp);
+    return created;
+}
+
+/*
+ * Map a ledger, creating it if it does not exist yet
+ * The ledger's tuples and range are used; tuples on the command line
+ * must match them.
+ */
+static void ledger_open(const char* path, uint64_t start, uint64_t end, uint32_t shard_bits) {
+    int fd = open(path, O_RDWR);
+
+    if (fd < 0 && errno == ENOENT && g_num_tuples > 0) {
+        if (ledger_create(path, start, end, shard_bits)) {
+            fprintf(stderr, "created ledger %s\n", path);
+        }
+        fd = open(path, O_RDWR);
+    }
+
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        exit(1);
+    }
+    if ((size_t)st.st_size < LEDGER_SHARDS_AT) {
+        fprintf(stderr, "%s: not a ledger\n", path);
+        exit(1);
+    }
+
+    void* map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+        exit(1);
+    }
+
+    ledger_header_t* h = map;
+    if (memcmp(h->magic, LEDGER_MAGIC, sizeof(h->magic)) != 0 || h->version != LEDGER_VERSION ||
+        h->num_tuples == 0 || h->num_tuples > MAX_TUPLES || h->shard_bits >= 48 ||
+        (size_t)st.st_size != LEDGER_SHARDS_AT + (size_t)h->num_shards * sizeof(ledger_shard_t)) {
+        fprintf(stderr, "%s: invalid ledger\n", path);
+        exit(1);
+    }
+
+    for (int t = 0; t < g_num_tuples; t++) {
+        if (t >= (int)h->num_tuples || memcmp(&g_tuples[t], &h->tuples[t], sizeof(tuple_t)) != 0) {
+            fprintf(stderr, "%s: tuples differ from the command line\n", path);
+            exit(1);
+        }
+    }
+    g_num_tuples = h->num_tuples;
+    memcpy(g_tuples, h->tuples, sizeof(tuple_t) * g_num_tuples);
+
+    g_ledger = h;
+    g_shards = (ledger_shard_t*)((uint8_t*)map + LEDGER_SHARDS_AT);
+    g_ledger_size = st.st_size;
+    g_host = host_hash();
+}
+
+/*
+ * Print the keys found by any ledger user
+ * Keys this process found are counted but were printed already.
+ * returns: number of distinct keys
+ */
+static int ledger_print_found(void) {
+    uint64_t seen[MAX_FOUND];
+    int n = 0;
+
+    for (int i = 0; i < MAX_FOUND; i++) {
+        uint64_t v = __atomic_load_n(&g_ledger->found[i], __ATOMIC_ACQUIRE);
+        bool dup = false;
+
+        if (!(v & LEDGER_FOUND_VALID)) {
+            continue;
+        }
+        v &= ~LEDGER_FOUND_VALID;
+        for (int j = 0; j < n; j++) {
+            dup |= seen[j] == v;
+        }
+        for (int j = 0; j < g_num_found && !dup; j++) {
+            if (g_found[j] == v) {
+                seen[n++] = v;
+                dup = true;
+            }
+        }
+        if (!dup) {
+            seen[n++] = v;
+            printf("KEY FOUND: %012" PRIX64 "\n", v);
+        }
+    }
+    return n;
+}
+
+/*
+ * Print shard counts, throughput and the shards in progress
+ */
+static void ledger_status(void) {
+    const ledger_header_t* h = g_ledger;
+    uint32_t done = 0, held = 0, stale = 0;
+    uint64_t keys = 0, ns = 0, searched = 0;
+
+    for (uint32_t i = 0; i < h->num_shards; i++) {
+        const ledger_shard_t* shard = &g_shards[i];
+        uint64_t claim = __atomic_load_n(&shard->claim, __ATOMIC_ACQUIRE);
+
+        keys += shard->keys;
+        ns += shard->ns;
+        searched += shard->searched;
+        if (claim == LEDGER_DONE) {
+            done++;
+        } else if (claim != 0) {
+            bool lost = ledger_stale(claim);
+            held += !lost;
+            stale += lost;
+            fprintf(stderr, "shard %8" PRIu32 "  %6.2f%%  host %08" PRIX32 " pid %-7" PRIu32 " %s\n",
+                    i, 100.0 * shard->searched / (1ULL << h->shard_bits), shard->host,
+                    shard->pid, lost ? "lease expired" : "");
+        }
+    }
+
+    fprintf(stderr, "ledger: %012" PRIX64 "-%012" PRIX64 ", %" PRIu32 " shards of 2^%" PRIu32
+            " keys\n", h->start, h->end, h->num_shards, h->shard_bits);
+    fprintf(stderr, "        %" PRIu32 " done, %" PRIu32 " in progress, %" PRIu32 " expired, %"
+            PRIu32 " free; %.2f%% of keys searched\n", done, held, stale,
+            h->num_shards - done - held - stale, 100.0 * searched / (h->end - h->start));
+    if (ns > 0) {
+        fprintf(stderr, "        %.1f Mkeys/s per worker thread\n", keys * 1e3 / ns);
+    }
+    ledger_print_found();
+}
+
+/*
+ * Pick the fastest batch kernel supported by this CPU
+ */
+static void select_kernel(void) {
+    static hitag2_key_t keys[BATCH_KEYS];
+    static uint32_t uids[BATCH_KEYS], challenges[BATCH_KEYS], responses[BATCH_KEYS];
+    crypto_kernel_t best = CRYPTO_KERNEL_SCALAR;
+    double best_ns = 0;
+
+    for (int i = 0; i < BATCH_KEYS; i++) {
+        key_unpack((uint64_t)i * 0x9E3779B97F4AULL, keys[i].bytes);
+        uids[i] = g_tuples[0].uid;
+        challenges[i] = g_tuples[0].challenge;
+    }
+
+    for (crypto_kernel_t k = CRYPTO_KERNEL_SCALAR; k < CRYPTO_KERNEL_COUNT; k++) {
+        if (!crypto_batch_set_kernel(k)) {
+            continue;
+        }
+
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (int r = 0; r < 8; r++) {
+            crypto_compute_response_batch(keys, uids, challenges, responses, BATCH_KEYS);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        double ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / (8.0 * BATCH_KEYS);
+        fprintf(stderr, "kernel %-8s %6.1f ns/key\n", crypto_batch_kernel_name(k), ns);
+
+        if (best_ns == 0 || ns < best_ns) {
+            best_ns = ns;
+            best = k;
+        }
+    }
+
+    crypto_batch_set_kernel(best);
+    fprintf(stderr, "using kernel %s\n", crypto_batch_kernel_name(best));
+}
+
+/*
+ * Stop workers on SIGINT/SIGTERM (checkpoint is written on exit)
+ */
+static void on_signal(int sig) {
+    (void)sig;
+    g_stop = 1;
+}
+
+/*
+ * Ledger mode: search shards of a shared ledger until none is left
+ */
+static int ledger_main(const char* path, uint64_t start, uint64_t end, int shard_bits,
+                       int threads, int interval, bool status_only) {
+    ledger_open(path, start, end, (uint32_t)shard_bits);
+
+    if (status_only) {
+        ledger_status();
+        return 0;
+    }
+    if (__atomic_load_n(&g_ledger->stop, __ATOMIC_ACQUIRE) && !g_find_all) {
+        return ledger_print_found() > 0 ? 0 : 1;
+    }
+
+    if (g_num_tuples < 2) {
+        fprintf(stderr, "warning: one tuple leaves ~2^16 false positives; add a second\n");
+    }
+
+    crypto_init();
+    select_kernel();
+
+    fprintf(stderr, "ledger %s: %" PRIu32 " shards, %" PRIu32 " done; %d threads\n", path,
+            g_ledger->num_shards, __atomic_load_n(&g_ledger->shards_done, __ATOMIC_RELAXED),
+            threads);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    g_num_workers = threads;
+    g_active = threads;
+    for (int i = 0; i < g_num_workers; i++) {
+        pthread_create(&g_workers[i].thread, NULL, worker_main, &g_workers[i]);
+    }
+
+    // Progress and periodic flushes of the ledger to disk
+    time_t started = time(NULL), last_sync = started;
+    while (__atomic_load_n(&g_active, __ATOMIC_ACQUIRE) > 0) {
+        sleep(1);
+
+        time_t now = time(NULL);
+        uint64_t done = __atomic_load_n(&g_keys_done, __ATOMIC_RELAXED);
+        uint32_t shards = __atomic_load_n(&g_ledger->shards_done, __ATOMIC_RELAXED);
+        fprintf(stderr, "\r%" PRIu32 "/%" PRIu32 " shards  %.1f Mkeys/s here   ", shards,
+                g_ledger->num_shards, done / (double)((now > started) ? now - started : 1) / 1e6);
+
+        if (now - last_sync >= interval) {
+            msync(g_ledger, g_ledger_size, MS_ASYNC);
+            last_sync = now;
+        }
+    }
+
+    for (int i = 0; i < g_num_workers; i++) {
+        pthread_join(g_workers[i].thread, NULL);
+    }
+    fprintf(stderr, "\n");
+    msync(g_ledger, g_ledger_size, MS_SYNC);
+
+    if (ledger_print_found() == 0) {
+        bool finished = __atomic_load_n(&g_ledger->shards_done, __ATOMIC_RELAXED) ==
+                        g_ledger->num_shards;
+        fprintf(stderr, "no key found%s\n", finished ? "" : " yet (shards left)");
+        return 1;
+    }
+    return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "usage: keysearch [-t threads] [-s start] [-e end] [-c checkpoint] [-i seconds] [-a]\n"
+        "                 UID:CHALLENGE:RESPONSE [UID:CHALLENGE:RESPONSE ...]\n"
+        "       keysearch [-t threads] [-s start] [-e end] [-S bits] [-i seconds] [-a] -L ledger\n"
+        "                 [UID:CHALLENGE:RESPONSE ...]\n"
+        "       keysearch -p -L ledger\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t start = 0, end = KEY_SPACE;
+    const char* checkpoint = NULL;
+    const char* ledger = NULL;
+    int shard_bits = 32;
+    bool status_only = false;
+    int interval = 60;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:s:e:c:i:aL:S:p")) != -1) {
+        switch (opt) {
+            case 't': threads = atoi(optarg); break;
+            case 's': if (!parse_hex(optarg, &start)) usage(); break;
+            case 'e': if (!parse_hex(optarg, &end)) usage(); break;
+            case 'c': checkpoint = optarg; break;
+            case 'i': interval = atoi(optarg); break;
+            case 'a': g_find_all = true; break;
+            case 'L': ledger = optarg; break;
+            case 'S': shard_bits = atoi(optarg); break;
+            case 'p': status_only = true; break;
+            default: usage();
+        }
+    }
+
+    for (int i = optind; i < argc; i++) {
+        if (g_num_tuples >= MAX_TUPLES || !parse_tuple(argv[i], &g_tuples[g_num_tuples])) {
+            usage();
+        }
+        g_num_tuples++;
+    }
+
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    if (interval < 1) interval = 1;
+    if (end > KEY_SPACE) end = KEY_SPACE;
+
+    if (ledger) {
+        if (checkpoint || start >= end || shard_bits < 16 || shard_bits > 47) {
+            usage();
+        }
+        return ledger_main(ledger, start, end, shard_bits, threads, interval, status_only);
+    }
+    if (status_only) {
+        usage();
+    }
+
+    range_t* ranges = NULL;
+    int num_ranges = checkpoint ? checkpoint_read(checkpoint, &ranges) : -1;
+    if (num_ranges < 0) {
+        if (g_num_tuples == 0 || start >= end) {
+            usage();
+        }
+        ranges = malloc(sizeof(range_t));
+        if (!ranges) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        ranges[0].next = start;
+        ranges[0].end = end;
+        num_ranges = 1;
+    } else {
+        fprintf(stderr, "resuming from %s (%d ranges)\n", checkpoint, num_ranges);
+
+        for (int i = 0; i < g_num_found; i++) {
+            printf("KEY FOUND: %012" PRIX64 "\n", g_found[i]);
+        }
+        if (g_num_found > 0 && !g_find_all) {
+            return 0;
+        }
+    }
+
+    if (g_num_tuples < 2) {
+        fprintf(stderr, "warning: one tuple leaves ~2^16 false positives; add a second\n");
+    }
+
+    crypto_init();
+    select_kernel();
+
+    // Spread the ranges over the workers in equal shares
+    uint64_t total = 0;
+    for (int i = 0; i < num_ranges; i++) {
+        total += ranges[i].end - ranges[i].next;
+    }
+
+    g_num_workers = threads;
+    for (int i = 0; i < g_num_workers; i++) {
+        pthread_mutex_init(&g_workers[i].lock, NULL);
+    }
+
+    // Each worker starts with one contiguous share; the remaining pieces
+    // of fragmented checkpoints wait in the pool
+    int r = 0;
+    uint64_t share = (total + threads - 1) / threads;
+    for (int i = 0; i < g_num_workers && r < num_ranges; i++) {
+        range_t* src = &ranges[r];
+        uint64_t n = src->end - src->next;
+        if (n > share) n = share;
+
+        g_workers[i].range.next = src->next;
+        g_workers[i].range.end = src->next + n;
+        src->next += n;
+        if (src->next >= src->end) {
+            r++;
+        }
+    }
+
+    g_pool = ranges;
+    g_pool_capacity = num_ranges;
+    for (; r < num_ranges; r++) {
+        if (ranges[r].next < ranges[r].end) {
+            g_pool[g_pool_size++] = ranges[r];
+        }
+    }
+
+    fprintf(stderr, "searching %" PRIu64 " keys on %d threads\n", total, threads);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    for (int i = 0; i < g_num_workers; i++) {
+        pthread_create(&g_workers[i].thread, NULL, worker_main, &g_workers[i]);
+    }
+
+    // Progress and periodic checkpoints until every worker is idle
+    time_t started = time(NULL), last_checkpoint = started;
+    for (;;) {
+        pthread_mutex_lock(&g_pool_lock);
+        bool busy = g_pool_size > 0;
+        pthread_mutex_unlock(&g_pool_lock);
+
+        for (int i = 0; i < g_num_workers; i++) {
+            pthread_mutex_lock(&g_workers[i].lock);
+            busy |= g_workers[i].range.next < g_workers[i].range.end ||
+                    g_workers[i].block.next < g_workers[i].block.end;
+            pthread_mutex_unlock(&g_workers[i].lock);
+        }
+        if (!busy || g_stop) {
+            break;
+        }
+
+        sleep(1);
+
+        time_t now = time(NULL);
+        uint64_t done = __atomic_load_n(&g_keys_done, __ATOMIC_RELAXED);
+        double rate = done / (double)((now > started) ? now - started : 1);
+        fprintf(stderr, "\r%6.2f%%  %.1f Mkeys/s  ETA %.0f s   ",
+                100.0 * done / total, rate / 1e6, (rate > 0) ? (total - done) / rate : 0.0);
+
+        if (checkpoint && now - last_checkpoint >= interval) {
+            checkpoint_write(checkpoint);
+            last_checkpoint = now;
+        }
+    }
+
+    for (int i = 0; i < g_num_workers; i++) {
+        pthread_join(g_workers[i].thread, NULL);
+    }
+    fprintf(stderr, "\n");
+
+    if (checkpoint) {
+        checkpoint_write(checkpoint);
+    }
+
+    if (g_num_found == 0) {
+        fprintf(stderr, "no key found%s\n", g_stop ? " (interrupted)" : "");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,237 @@
+/*
+ * Hi-Tag 2 Emulator - Token Store Benchmark
+ * Runs the flash token store on a file-backed region and reports append
+ * rate, boot index time, write amplification and wear
+ *
+ * Usage: store_bench [options]
+ *   -f FILE    backing file (default: store_bench.bin, recreated)
+ *   -p PAGES   region size in 4 KB flash pages (default 16, as on the PIC32)
+ *   -n N       records to append (default 100000)
+ *   -k KEYS    distinct keys written (default 372, a full 32 KB bank)
+ *   -d PCT     percentage of appends that delete (default 5)
+ *   -x CUTS    power-cut trials after the run (default 100)
+ *   -s SEED    generator seed (hex, default 1)
+ *
+ * Write amplification is flash bytes programmed (records, copies made
+ * by compaction, page headers) per byte of token image the caller put.
+ * A record alone is 48 bytes for 32, so 1.5 is the floor.
+ *
+ * A power-cut trial stops the flash part way through an append (see
+ * flash_file_fail_after()), rebuilds the index as a reboot would and
+ * checks that every key reads back the image it had before the append
+ * or, for the key being written, the new one.
+ *
+ * The PIC32 estimate uses the datasheet word program and page erase
+ * times; on the target the CPU stalls for both.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "flash.h"
+#include "token_store.h"
+
+#define PIC32_WORD_PROGRAM_US  20.0
+#define PIC32_PAGE_ERASE_US    20000.0
+
+// What the store should hold
+typedef struct {
+    bool present;
+    uint8_t image[TOKEN_STORE_IMAGE_SIZE];
+} shadow_t;
+
+static shadow_t* g_shadow;
+static uint32_t g_keys;
+
+/*
+ * Step a xorshift64 generator
+ */
+static uint64_t next_random(uint64_t* seed) {
+    uint64_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *seed = x;
+    return x;
+}
+
+static double seconds_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void random_image(uint8_t* image, uint64_t* seed) {
+    for (int i = 0; i < TOKEN_STORE_IMAGE_SIZE; i += 8) {
+        uint64_t r = next_random(seed);
+        memcpy(&image[i], &r, 8);
+    }
+}
+
+/*
+ * Compare one key of the store with the shadow
+ */
+static bool check_key(uint16_t key, const shadow_t* expect) {
+    uint8_t image[TOKEN_STORE_IMAGE_SIZE];
+    bool present = token_store_get(key, image);
+
+    if (present != expect->present) {
+        return false;
+    }
+    return !present || memcmp(image, expect->image, TOKEN_STORE_IMAGE_SIZE) == 0;
+}
+
+/*
+ * Compare every key, returning the number that differ
+ */
+static uint32_t check_all(void) {
+    uint32_t bad = 0;
+
+    for (uint32_t k = 0; k < g_keys; k++) {
+        if (!check_key((uint16_t)k, &g_shadow[k])) {
+            bad++;
+        }
+    }
+    return bad;
+}
+
+/*
+ * Apply one random put or delete to the store and the shadow
+ */
+static bool random_op(uint32_t delete_pct, uint64_t* seed, uint16_t* key, shadow_t* after) {
+    *key = next_random(seed) % g_keys;
+    after->present = (next_random(seed) % 100) >= delete_pct;
+
+    if (after->present) {
+        random_image(after->image, seed);
+        return token_store_put(*key, after->image);
+    }
+    return token_store_delete(*key);
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: store_bench [-f file] [-p pages] [-n records] [-k keys] "
+                    "[-d delete%%] [-x cuts] [-s seed]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    const char* path = "store_bench.bin";
+    uint32_t pages = 16, n = 100000, delete_pct = 5, cuts = 100;
+    uint64_t seed = 1;
+    int opt;
+
+    g_keys = 372;
+    while ((opt = getopt(argc, argv, "f:p:n:k:d:x:s:")) != -1) {
+        switch (opt) {
+            case 'f': path = optarg; break;
+            case 'p': pages = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'n': n = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'k': g_keys = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'd': delete_pct = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'x': cuts = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 's': seed = strtoull(optarg, NULL, 16); break;
+            default: usage();
+        }
+    }
+    if (pages < 3 || pages > TOKEN_STORE_MAX_PAGES || g_keys == 0 ||
+        g_keys > TOKEN_STORE_KEYS || delete_pct > 100 || seed == 0) {
+        usage();
+    }
+
+    g_shadow = calloc(g_keys, sizeof(shadow_t));
+    if (!g_shadow) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    unlink(path);
+    if (!flash_file_open(path, pages * FLASH_PAGE_SIZE) || !token_store_format()) {
+        fprintf(stderr, "%s: cannot format a %" PRIu32 "-page store\n", path, pages);
+        return 1;
+    }
+
+    // Append run
+    uint32_t image_bytes = 0;
+    double t0 = seconds_now();
+    for (uint32_t i = 0; i < n; i++) {
+        uint16_t key;
+        shadow_t after;
+
+        if (!random_op(delete_pct, &seed, &key, &after)) {
+            fprintf(stderr, "append %" PRIu32 " (key %u) failed\n", i, key);
+            return 1;
+        }
+        if (after.present) {
+            image_bytes += TOKEN_STORE_IMAGE_SIZE;
+        }
+        g_shadow[key] = after;
+    }
+    double t_run = seconds_now() - t0;
+
+    token_store_stats_t stats;
+    token_store_stats(&stats);
+
+    // Reboot: rebuild the index from the file
+    flash_file_close();
+    if (!flash_file_open(path, pages * FLASH_PAGE_SIZE)) {
+        return 1;
+    }
+    t0 = seconds_now();
+    bool ok = token_store_init();
+    double t_boot = seconds_now() - t0;
+    uint32_t bad = ok ? check_all() : g_keys;
+
+    double pic32_us = (stats.bytes_written / 4) * PIC32_WORD_PROGRAM_US +
+                      stats.compactions * PIC32_PAGE_ERASE_US;
+
+    printf("region         %" PRIu32 " pages (%" PRIu32 " KB), %" PRIu32 " keys, %" PRIu32 "%% deletes\n",
+           pages, pages * FLASH_PAGE_SIZE / 1024, g_keys, delete_pct);
+    printf("appends        %" PRIu32 " in %.3f s: %.0f records/s\n", n, t_run, n / t_run);
+    printf("boot index     %.3f ms, %u keys, %s\n", t_boot * 1e3, stats.keys,
+           bad ? "MISMATCH" : "verified");
+    printf("compaction     %" PRIu32 " pages, %" PRIu32 " records copied\n",
+           stats.compactions, stats.copies);
+    printf("write amp      %.2f (%" PRIu32 " flash bytes for %" PRIu32 " image bytes)\n",
+           image_bytes ? (double)stats.bytes_written / image_bytes : 0.0,
+           stats.bytes_written, image_bytes);
+    printf("wear           erases per page %" PRIu32 "..%" PRIu32 "\n",
+           stats.min_erase, stats.max_erase);
+    printf("PIC32 estimate %.0f us per append\n", n ? pic32_us / n : 0.0);
+
+    // Power-cut trials
+    uint32_t cut_bad = 0;
+    for (uint32_t t = 0; t < cuts && !bad; t++) {
+        uint16_t key;
+        shadow_t after;
+
+        // Up to a record and a half of words, sometimes into compaction
+        flash_file_fail_after(next_random(&seed) % 18);
+        random_op(delete_pct, &seed, &key, &after);
+
+        flash_file_close();
+        if (!flash_file_open(path, pages * FLASH_PAGE_SIZE) || !token_store_init()) {
+            cut_bad++;
+            break;
+        }
+
+        shadow_t before = g_shadow[key];
+        if (check_key(key, &after)) {
+            g_shadow[key] = after;
+        } else if (!check_key(key, &before)) {
+            cut_bad++;
+        }
+        cut_bad += check_all();
+    }
+    if (cuts) {
+        printf("power cuts     %" PRIu32 " trials, %s\n", cuts, cut_bad ? "CORRUPTED" : "consistent");
+    }
+
+    flash_file_close();
+    free(g_shadow);
+    return (bad || cut_bad) ? 1 : 0;
+}
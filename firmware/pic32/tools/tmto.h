@@ -0,0 +1,158 @@
+/*
+ * Hi-Tag 2 Emulator - Time-Memory Tradeoff Tables
+ * Chain definition and on-disk format shared by tmto_build and tmto_lookup
+ *
+ * A table inverts F(key) = crypto_compute_response(key, uid, challenge)
+ * for one fixed UID and challenge. Chains are rainbow chains of t keys:
+ *
+ *   x[0]   = start point of chain i (derived from i and the table number)
+ *   x[c+1] = R(c, F(x[c]))          for c = 0 .. t-1
+ *
+ * and x[t] is the stored endpoint. R(c, y) puts the 32-bit response in
+ * Key[47:16] and a per-column constant in Key[15:0] (XORed over the
+ * whole key), so every column reaches a different 2^32 slice of the key
+ * space. Tables with a different number use different constants and
+ * can be combined into a set for more coverage.
+ *
+ * A 32-bit response has ~2^16 keys, so a lookup finds keys consistent
+ * with the response; a second tuple of the same token rejects the wrong
+ * ones (as in keysearch).
+ *
+ * File layout (little-endian, mmap'ed by the lookup tool):
+ *   tmto_header_t
+ *   uint64_t index[TMTO_INDEX_SIZE + 1]   entries with endpoint bits
+ *                                         47:32 == b are index[b]..index[b+1]-1
+ *   tmto_entry_t entries[]                sorted by endpoint, no duplicates
+ */
+
+#ifndef TMTO_H
+#define TMTO_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "crypto.h"
+
+#define TMTO_MAGIC          "HT2TMTO"
+#define TMTO_VERSION        1
+#define TMTO_KEY_MASK       0xFFFFFFFFFFFFULL
+#define TMTO_INDEX_BITS     16
+#define TMTO_INDEX_SIZE     (1UL << TMTO_INDEX_BITS)
+
+// Lanes per batch kernel call when walking chains
+#define TMTO_LANES          1024
+
+// File header (64 bytes)
+typedef struct {
+    char magic[8];              // TMTO_MAGIC, NUL terminated
+    uint32_t version;           // TMTO_VERSION
+    uint32_t uid;
+    uint32_t challenge;
+    uint32_t table;             // Table number within a set (selects R)
+    uint32_t chain_len;         // t
+    uint32_t reserved;
+    uint64_t chains;            // Start points walked (chain i = 0 .. chains-1)
+    uint64_t entries;           // Distinct endpoints stored
+    uint8_t pad[16];
+} tmto_header_t;
+
+// Table entry: endpoint bits 31:0 (bits 47:32 are the index bucket)
+// and the number of the chain that reaches it
+typedef struct {
+    uint32_t end;
+    uint32_t start;
+} tmto_entry_t;
+
+// Batch buffers for walking TMTO_LANES chains at once
+typedef struct {
+    hitag2_key_t keys[TMTO_LANES];
+    uint32_t uids[TMTO_LANES];
+    uint32_t challenges[TMTO_LANES];
+    uint32_t responses[TMTO_LANES];
+} tmto_scratch_t;
+
+/*
+ * 64-bit mixing function (splitmix64 finalizer)
+ */
+static inline uint64_t tmto_mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/*
+ * Start point of chain i
+ */
+static inline uint64_t tmto_start(const tmto_header_t* h, uint32_t i) {
+    return tmto_mix(((uint64_t)h->table << 32) ^ i ^ 0x5354415254000000ULL) & TMTO_KEY_MASK;
+}
+
+/*
+ * Reduction function of column c
+ */
+static inline uint64_t tmto_reduce(const tmto_header_t* h, uint32_t c, uint32_t response) {
+    uint64_t salt = tmto_mix(((uint64_t)h->table << 32) | c);
+    return (((uint64_t)response << 16) ^ salt) & TMTO_KEY_MASK;
+}
+
+/*
+ * Unpack a 48-bit key value into the firmware's byte order
+ */
+static inline void tmto_key_unpack(uint64_t value, uint8_t* key) {
+    for (int j = 0; j < 6; j++) {
+        key[j] = (value >> (8 * j)) & 0xFF;
+    }
+}
+
+/*
+ * Prepare the batch buffers for a table
+ */
+static inline void tmto_scratch_init(tmto_scratch_t* s, const tmto_header_t* h) {
+    for (int i = 0; i < TMTO_LANES; i++) {
+        s->uids[i] = h->uid;
+        s->challenges[i] = h->challenge;
+    }
+}
+
+/*
+ * Walk up to TMTO_LANES chains in lockstep with the batch kernel
+ * Lane i goes from the key at column col[i] to the key at column end[i].
+ * Lanes that are already done keep their key (their slots are still
+ * computed, so keep the columns of one call close together).
+ */
+static inline void tmto_walk(const tmto_header_t* h, tmto_scratch_t* s, uint64_t* x,
+                             uint32_t* col, const uint32_t* end, uint32_t n) {
+    for (;;) {
+        bool active = false;
+
+        for (uint32_t i = 0; i < n; i++) {
+            active |= col[i] < end[i];
+            tmto_key_unpack(x[i], s->keys[i].bytes);
+        }
+        if (!active) {
+            return;
+        }
+
+        crypto_compute_response_batch(s->keys, s->uids, s->challenges, s->responses, n);
+
+        for (uint32_t i = 0; i < n; i++) {
+            if (col[i] < end[i]) {
+                x[i] = tmto_reduce(h, col[i], s->responses[i]);
+                col[i]++;
+            }
+        }
+    }
+}
+
+/*
+ * Check a header read from disk
+ */
+static inline bool tmto_header_valid(const tmto_header_t* h) {
+    return memcmp(h->magic, TMTO_MAGIC, sizeof(TMTO_MAGIC)) == 0 &&
+           h->version == TMTO_VERSION && h->chain_len > 0 && h->entries <= h->chains;
+}
+
+#endif // TMTO_H
@@ -0,0 +1,459 @@
+/*
+ * Hi-Tag 2 Emulator - Time-Memory Tradeoff Table Builder
+ * Precomputes rainbow chains for one UID and challenge (see tmto.h)
+ *
+ * Usage: tmto_build [options] -o FILE UID:CHALLENGE
+ *   -o FILE    output table
+ *   -t N       chain length (default 4096)
+ *   -n N       number of chains, at most 2^32 (default 2^24)
+ *   -T N       table number within a set (default 0)
+ *   -j N       worker threads (default: all cores)
+ *   -m MB      memory for chains in flight (default 1024)
+ *
+ * Values are hex except the counts. A table covers about t * n keys,
+ * less the chains that merge. Full coverage of a 48-bit key space needs
+ * t * n around 2^48 split over several tables, e.g. -t 65536 -n 2^32
+ * for each of -T 0..3 (32 GiB per table).
+ *
+ * Building streams to disk: each worker walks a chunk of chains with
+ * the batch kernel, sorts the endpoints and writes them to a run file
+ * next to the output. The runs are then merged (at most MERGE_WAYS at a
+ * time) into the final table, dropping chains with duplicate endpoints.
+ * Memory use is bounded by -m whatever the table size.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "crypto.h"
+#include "tmto.h"
+
+#define MAX_THREADS     256
+#define MERGE_WAYS      128             // Run files open at once
+#define RUN_BUFFER      4096            // Entries buffered per open run
+
+// Endpoint with its chain number, as sorted in run files
+typedef struct {
+    uint64_t end;
+    uint32_t start;
+    uint32_t reserved;
+} run_entry_t;
+
+// Buffered reader of one run file
+typedef struct {
+    FILE* file;
+    run_entry_t buffer[RUN_BUFFER];
+    size_t pos;
+    size_t count;
+} run_reader_t;
+
+static tmto_header_t g_header;
+static const char* g_output = NULL;
+
+static uint64_t g_chunk_chains = 0;
+static uint32_t g_num_chunks = 0;
+static uint32_t g_next_chunk = 0;       // Updated atomically
+static uint64_t g_chains_done = 0;      // Updated atomically
+static volatile int g_failed = 0;
+
+/*
+ * Parse a number (hex with 0x, decimal, or 2^N)
+ */
+static bool parse_count(const char* text, uint64_t* value) {
+    char* end;
+
+    errno = 0;
+    if (strncmp(text, "2^", 2) == 0) {
+        unsigned long bits = strtoul(text + 2, &end, 10);
+        *value = (bits < 64) ? (1ULL << bits) : 0;
+        return errno == 0 && end != text + 2 && *end == '\0' && bits < 64;
+    }
+    *value = strtoull(text, &end, 0);
+    return errno == 0 && end != text && *end == '\0';
+}
+
+/*
+ * Name of run file n
+ */
+static void run_path(char* path, size_t size, uint32_t n) {
+    snprintf(path, size, "%s.run%u", g_output, n);
+}
+
+static int run_entry_compare(const void* a, const void* b) {
+    uint64_t x = ((const run_entry_t*)a)->end;
+    uint64_t y = ((const run_entry_t*)b)->end;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Walk one chunk of chains and write its sorted endpoints to a run file
+ */
+static bool build_chunk(uint32_t chunk, run_entry_t* entries, tmto_scratch_t* s) {
+    uint64_t first = (uint64_t)chunk * g_chunk_chains;
+    uint64_t count = g_header.chains - first;
+    uint64_t x[TMTO_LANES];
+    uint32_t col[TMTO_LANES], end[TMTO_LANES];
+    size_t n = 0;
+
+    if (count > g_chunk_chains) {
+        count = g_chunk_chains;
+    }
+
+    for (uint64_t base = 0; base < count; base += TMTO_LANES) {
+        uint32_t lanes = (count - base < TMTO_LANES) ? (uint32_t)(count - base) : TMTO_LANES;
+
+        for (uint32_t i = 0; i < lanes; i++) {
+            x[i] = tmto_start(&g_header, (uint32_t)(first + base + i));
+            col[i] = 0;
+            end[i] = g_header.chain_len;
+        }
+
+        tmto_walk(&g_header, s, x, col, end, lanes);
+
+        for (uint32_t i = 0; i < lanes; i++) {
+            entries[base + i].end = x[i];
+            entries[base + i].start = (uint32_t)(first + base + i);
+            entries[base + i].reserved = 0;
+        }
+        __atomic_fetch_add(&g_chains_done, lanes, __ATOMIC_RELAXED);
+    }
+
+    // Chains with the same endpoint cover the same keys from there on
+    qsort(entries, count, sizeof(run_entry_t), run_entry_compare);
+    for (uint64_t i = 0; i < count; i++) {
+        if (n == 0 || entries[i].end != entries[n - 1].end) {
+            entries[n++] = entries[i];
+        }
+    }
+
+    char path[4096];
+    run_path(path, sizeof(path), chunk);
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    bool ok = fwrite(entries, sizeof(run_entry_t), n, f) == n;
+    ok = (fclose(f) == 0) && ok;
+    if (!ok) {
+        perror(path);
+    }
+    return ok;
+}
+
+/*
+ * Worker thread: build chunks until none are left
+ */
+static void* worker_main(void* arg) {
+    (void)arg;
+    tmto_scratch_t* s = malloc(sizeof(tmto_scratch_t));
+    run_entry_t* entries = malloc(g_chunk_chains * sizeof(run_entry_t));
+
+    if (!s || !entries) {
+        fprintf(stderr, "out of memory\n");
+        g_failed = 1;
+    } else {
+        tmto_scratch_init(s, &g_header);
+    }
+
+    while (!g_failed) {
+        uint32_t chunk = __atomic_fetch_add(&g_next_chunk, 1, __ATOMIC_RELAXED);
+        if (chunk >= g_num_chunks) {
+            break;
+        }
+        if (!build_chunk(chunk, entries, s)) {
+            g_failed = 1;
+        }
+    }
+
+    free(entries);
+    free(s);
+    return NULL;
+}
+
+/*
+ * Current entry of a run reader (refills the buffer)
+ * returns: NULL at the end of the run
+ */
+static const run_entry_t* run_peek(run_reader_t* r) {
+    if (r->pos == r->count) {
+        r->count = fread(r->buffer, sizeof(run_entry_t), RUN_BUFFER, r->file);
+        r->pos = 0;
+        if (r->count == 0) {
+            return NULL;
+        }
+    }
+    return &r->buffer[r->pos];
+}
+
+/*
+ * Restore the heap order below slot i (min-heap on the current endpoint)
+ */
+static void heap_down(run_reader_t** heap, int n, int i) {
+    for (;;) {
+        int smallest = i;
+        int l = 2 * i + 1, r = 2 * i + 2;
+
+        if (l < n && run_peek(heap[l])->end < run_peek(heap[smallest])->end) smallest = l;
+        if (r < n && run_peek(heap[r])->end < run_peek(heap[smallest])->end) smallest = r;
+        if (smallest == i) {
+            return;
+        }
+
+        run_reader_t* t = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = t;
+        i = smallest;
+    }
+}
+
+/*
+ * Merge run files first .. first+n-1 (deleted afterwards)
+ * final: write table entries and bucket counts, otherwise run entries
+ * returns: entries written, or -1 on error
+ */
+static int64_t merge_runs(uint32_t first, int n, FILE* out, bool final, uint64_t* buckets) {
+    run_reader_t* readers = calloc(n, sizeof(run_reader_t));
+    run_reader_t** heap = calloc(n, sizeof(run_reader_t*));
+    char path[4096];
+    int heap_size = 0;
+    int64_t written = 0;
+    uint64_t last = UINT64_MAX;
+
+    if (!readers || !heap) {
+        fprintf(stderr, "out of memory\n");
+        free(readers);
+        free(heap);
+        return -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+        run_path(path, sizeof(path), first + i);
+        readers[i].file = fopen(path, "rb");
+        if (!readers[i].file) {
+            perror(path);
+            written = -1;
+        } else if (run_peek(&readers[i])) {
+            heap[heap_size++] = &readers[i];
+        }
+    }
+
+    for (int i = heap_size / 2 - 1; i >= 0 && written >= 0; i--) {
+        heap_down(heap, heap_size, i);
+    }
+
+    while (heap_size > 0 && written >= 0) {
+        run_reader_t* r = heap[0];
+        run_entry_t e = r->buffer[r->pos++];
+
+        if (!run_peek(r)) {
+            heap[0] = heap[--heap_size];
+        }
+        heap_down(heap, heap_size, 0);
+
+        if (e.end == last) {
+            continue;
+        }
+        last = e.end;
+
+        bool ok;
+        if (final) {
+            tmto_entry_t t = {(uint32_t)e.end, e.start};
+            buckets[e.end >> 32]++;
+            ok = fwrite(&t, sizeof(t), 1, out) == 1;
+        } else {
+            ok = fwrite(&e, sizeof(e), 1, out) == 1;
+        }
+        written = ok ? written + 1 : -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (readers[i].file) {
+            fclose(readers[i].file);
+            run_path(path, sizeof(path), first + i);
+            unlink(path);
+        }
+    }
+    free(readers);
+    free(heap);
+    return written;
+}
+
+/*
+ * Merge every run into the table (via intermediate runs when there
+ * are more than MERGE_WAYS), then write index and header
+ */
+static bool write_table(void) {
+    uint32_t first = 0, count = g_num_chunks;
+    char path[4096], tmp[4096];
+
+    while (count > MERGE_WAYS) {
+        uint32_t next = first + count;
+        uint32_t merged = 0;
+
+        for (uint32_t i = 0; i < count; i += MERGE_WAYS, merged++) {
+            int n = (count - i < MERGE_WAYS) ? (int)(count - i) : MERGE_WAYS;
+            run_path(path, sizeof(path), next + merged);
+            FILE* f = fopen(path, "wb");
+            if (!f) {
+                perror(path);
+                return false;
+            }
+            bool ok = merge_runs(first + i, n, f, false, NULL) >= 0;
+            if (fclose(f) != 0 || !ok) {
+                perror(path);
+                return false;
+            }
+        }
+        first = next;
+        count = merged;
+    }
+
+    uint64_t* index = calloc(TMTO_INDEX_SIZE + 1, sizeof(uint64_t));
+    if (!index) {
+        fprintf(stderr, "out of memory\n");
+        return false;
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", g_output);
+    FILE* f = fopen(tmp, "wb");
+    if (!f) {
+        perror(tmp);
+        free(index);
+        return false;
+    }
+
+    // Entries follow the header and index, which are written last
+    long offset = (long)(sizeof(tmto_header_t) + (TMTO_INDEX_SIZE + 1) * sizeof(uint64_t));
+    int64_t entries = -1;
+    if (fseek(f, offset, SEEK_SET) == 0) {
+        entries = merge_runs(first, (int)count, f, true, index + 1);
+    }
+
+    for (uint32_t b = 1; b <= TMTO_INDEX_SIZE; b++) {
+        index[b] += index[b - 1];
+    }
+    g_header.entries = (entries > 0) ? (uint64_t)entries : 0;
+
+    bool ok = entries >= 0 && fseek(f, 0, SEEK_SET) == 0 &&
+              fwrite(&g_header, sizeof(g_header), 1, f) == 1 &&
+              fwrite(index, sizeof(uint64_t), TMTO_INDEX_SIZE + 1, f) == TMTO_INDEX_SIZE + 1;
+    ok = ok && (fflush(f) == 0) && (fsync(fileno(f)) == 0);
+    ok = (fclose(f) == 0) && ok;
+    free(index);
+
+    if (!ok || rename(tmp, g_output) != 0) {
+        perror(g_output);
+        unlink(tmp);
+        return false;
+    }
+    return true;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "usage: tmto_build [-t chain_len] [-n chains] [-T table] [-j threads] [-m MB]\n"
+        "                  -o FILE UID:CHALLENGE\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t chain_len = 4096, chains = 1ULL << 24, table = 0, memory_mb = 1024;
+    unsigned int uid, challenge;
+    char extra;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:t:n:T:j:m:")) != -1) {
+        switch (opt) {
+            case 'o': g_output = optarg; break;
+            case 't': if (!parse_count(optarg, &chain_len)) usage(); break;
+            case 'n': if (!parse_count(optarg, &chains)) usage(); break;
+            case 'T': if (!parse_count(optarg, &table)) usage(); break;
+            case 'j': threads = atoi(optarg); break;
+            case 'm': if (!parse_count(optarg, &memory_mb)) usage(); break;
+            default: usage();
+        }
+    }
+
+    if (!g_output || optind != argc - 1 ||
+        sscanf(argv[optind], "%x:%x%c", &uid, &challenge, &extra) != 2) {
+        usage();
+    }
+    if (chain_len < 1 || chain_len > UINT32_MAX || chains < 1 || chains > (1ULL << 32) ||
+        table > UINT32_MAX) {
+        fprintf(stderr, "chain length and table must fit 32 bits, chains at most 2^32\n");
+        return 2;
+    }
+
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+    memcpy(g_header.magic, TMTO_MAGIC, sizeof(TMTO_MAGIC));
+    g_header.version = TMTO_VERSION;
+    g_header.uid = uid;
+    g_header.challenge = challenge;
+    g_header.table = (uint32_t)table;
+    g_header.chain_len = (uint32_t)chain_len;
+    g_header.chains = chains;
+
+    // One chunk per worker in flight, in whole batches
+    g_chunk_chains = (memory_mb << 20) / sizeof(run_entry_t) / threads;
+    g_chunk_chains -= g_chunk_chains % TMTO_LANES;
+    if (g_chunk_chains < TMTO_LANES) {
+        g_chunk_chains = TMTO_LANES;
+    }
+    g_num_chunks = (uint32_t)((chains + g_chunk_chains - 1) / g_chunk_chains);
+    if ((uint64_t)threads > g_num_chunks) {
+        threads = (int)g_num_chunks;
+    }
+
+    crypto_init();
+    fprintf(stderr, "table %u for %08X:%08X: %" PRIu64 " chains of %" PRIu64 " keys, "
+            "%u chunks on %d threads, kernel %s\n",
+            g_header.table, uid, challenge, chains, chain_len, g_num_chunks, threads,
+            crypto_batch_kernel_name(crypto_batch_get_kernel()));
+
+    pthread_t workers[MAX_THREADS];
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&workers[i], NULL, worker_main, NULL);
+    }
+
+    // Progress until every chain is walked
+    time_t started = time(NULL);
+    for (;;) {
+        uint64_t done = __atomic_load_n(&g_chains_done, __ATOMIC_RELAXED);
+        if (done >= chains || g_failed) {
+            break;
+        }
+
+        sleep(1);
+
+        time_t now = time(NULL);
+        double rate = done / (double)((now > started) ? now - started : 1);
+        fprintf(stderr, "\r%6.2f%%  %.1f Mkeys/s  ETA %.0f s   ",
+                100.0 * done / chains, rate * chain_len / 1e6,
+                (rate > 0) ? (chains - done) / rate : 0.0);
+    }
+
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    fprintf(stderr, "\n");
+
+    if (g_failed || !write_table()) {
+        fprintf(stderr, "build failed\n");
+        return 1;
+    }
+
+    fprintf(stderr, "%s: %" PRIu64 " distinct endpoints (%.1f%% of chains), ~%.2f%% key coverage\n",
+            g_output, g_header.entries, 100.0 * g_header.entries / chains,
+            100.0 * (double)g_header.entries * chain_len / (double)(1ULL << 48));
+    return 0;
+}
@@ -0,0 +1,366 @@
+/*
+ * Hi-Tag 2 Emulator - Time-Memory Tradeoff Table Lookup
+ * Finds the key of a captured authentication in tables from tmto_build
+ *
+ * Usage: tmto_lookup [options] -f TABLE [-f TABLE ...]
+ *                    UID:CHALLENGE:RESPONSE [UID:CHALLENGE:RESPONSE ...]
+ *   -f FILE    table to search (repeat for a table set)
+ *   -j N       worker threads (default: all cores)
+ *   -a         report every matching key instead of stopping at the first
+ *
+ * The first tuple is looked up; its UID and challenge must be those the
+ * tables were built for (other tables are skipped). Further tuples of
+ * the same token confirm a key, as in keysearch.
+ *
+ * Tables are mmap'ed read-only and only the index buckets and entries a
+ * query touches are paged in, so a lookup needs neither the memory nor
+ * the load time of a whole table and the page cache is shared between
+ * concurrent lookups.
+ *
+ * For each column j the response is reduced and walked to the end of
+ * the chain; an endpoint found in the table gives a chain that is
+ * regenerated from its start to column j. Columns are searched from the
+ * last (cheapest) to the first in groups of TMTO_LANES, one group per
+ * batch kernel pass, and groups of every table are spread over the
+ * workers.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "crypto.h"
+#include "tmto.h"
+
+#define MAX_TABLES      64
+#define MAX_TUPLES      8
+#define MAX_THREADS     256
+#define MAX_FOUND       64
+
+// Captured authentication
+typedef struct {
+    uint32_t uid;
+    uint32_t challenge;
+    uint32_t response;
+} tuple_t;
+
+// Mapped table
+typedef struct {
+    const char* path;
+    const tmto_header_t* header;
+    const uint64_t* index;
+    const tmto_entry_t* entries;
+    size_t size;
+    uint32_t groups;        // Column groups of TMTO_LANES
+} table_t;
+
+static tuple_t g_tuples[MAX_TUPLES];
+static int g_num_tuples = 0;
+
+static table_t g_tables[MAX_TABLES];
+static int g_num_tables = 0;
+
+static uint32_t g_num_items = 0;        // Groups x tables
+static uint32_t g_next_item = 0;        // Updated atomically
+static uint64_t g_false_alarms = 0;     // Updated atomically
+
+static pthread_mutex_t g_found_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t g_found[MAX_FOUND];
+static int g_num_found = 0;
+static bool g_find_all = false;
+static volatile int g_stop = 0;
+
+/*
+ * Parse UID:CHALLENGE:RESPONSE
+ */
+static bool parse_tuple(const char* text, tuple_t* tuple) {
+    unsigned int uid, challenge, response;
+    char extra;
+
+    if (sscanf(text, "%x:%x:%x%c", &uid, &challenge, &response, &extra) != 3) {
+        return false;
+    }
+
+    tuple->uid = uid;
+    tuple->challenge = challenge;
+    tuple->response = response;
+    return true;
+}
+
+/*
+ * Map a table and check its header and size
+ */
+static bool table_open(table_t* t, const char* path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    t->path = path;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+
+    size_t header_size = sizeof(tmto_header_t) + (TMTO_INDEX_SIZE + 1) * sizeof(uint64_t);
+    if ((size_t)st.st_size < header_size) {
+        fprintf(stderr, "%s: not a table\n", path);
+        close(fd);
+        return false;
+    }
+
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+        return false;
+    }
+
+    t->size = st.st_size;
+    t->header = map;
+    t->index = (const uint64_t*)(t->header + 1);
+    t->entries = (const tmto_entry_t*)(t->index + TMTO_INDEX_SIZE + 1);
+
+    if (!tmto_header_valid(t->header) ||
+        t->size != header_size + t->header->entries * sizeof(tmto_entry_t) ||
+        t->index[TMTO_INDEX_SIZE] != t->header->entries) {
+        fprintf(stderr, "%s: invalid table\n", path);
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    // Lookups touch one bucket per column: no readahead
+    madvise(map, st.st_size, MADV_RANDOM);
+
+    t->groups = (t->header->chain_len + TMTO_LANES - 1) / TMTO_LANES;
+    return true;
+}
+
+/*
+ * Find the chain ending at key value x
+ * returns: entry, or NULL if no chain ends there
+ */
+static const tmto_entry_t* table_find(const table_t* t, uint64_t x) {
+    uint32_t bucket = (uint32_t)(x >> 32);
+    uint32_t end = (uint32_t)x;
+    uint64_t lo = t->index[bucket], hi = t->index[bucket + 1];
+
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (t->entries[mid].end < end) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return (lo < t->index[bucket + 1] && t->entries[lo].end == end) ? &t->entries[lo] : NULL;
+}
+
+/*
+ * Check a candidate against every tuple and record it
+ */
+static void key_check(uint64_t value) {
+    uint8_t key[6];
+    tmto_key_unpack(value, key);
+
+    for (int t = 0; t < g_num_tuples; t++) {
+        if (!crypto_verify_response(key, g_tuples[t].uid, g_tuples[t].challenge,
+                                    g_tuples[t].response)) {
+            __atomic_fetch_add(&g_false_alarms, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&g_found_lock);
+
+    // Several tables can hold the same key
+    for (int i = 0; i < g_num_found; i++) {
+        if (g_found[i] == value) {
+            pthread_mutex_unlock(&g_found_lock);
+            return;
+        }
+    }
+
+    if (g_num_found < MAX_FOUND) {
+        g_found[g_num_found++] = value;
+    }
+    printf("KEY FOUND: %012" PRIX64 "\n", value);
+    fflush(stdout);
+
+    if (!g_find_all) {
+        g_stop = 1;
+    }
+
+    pthread_mutex_unlock(&g_found_lock);
+}
+
+/*
+ * Search one group of columns of a table
+ */
+static void search_group(const table_t* t, uint32_t group, tmto_scratch_t* s) {
+    const tmto_header_t* h = t->header;
+    uint64_t x[TMTO_LANES];
+    uint32_t col[TMTO_LANES], end[TMTO_LANES], column[TMTO_LANES];
+    uint32_t last = h->chain_len - group * TMTO_LANES;
+    uint32_t first = (last > TMTO_LANES) ? last - TMTO_LANES : 0;
+    uint32_t lanes = last - first;
+    uint32_t hits = 0;
+
+    // Walk from the key after each column to the endpoint
+    for (uint32_t i = 0; i < lanes; i++) {
+        column[i] = first + i;
+        x[i] = tmto_reduce(h, column[i], g_tuples[0].response);
+        col[i] = column[i] + 1;
+        end[i] = h->chain_len;
+    }
+    tmto_walk(h, s, x, col, end, lanes);
+
+    // Regenerate the chains found up to the column they matched at
+    for (uint32_t i = 0; i < lanes; i++) {
+        const tmto_entry_t* e = table_find(t, x[i]);
+        if (e) {
+            x[hits] = tmto_start(h, e->start);
+            col[hits] = 0;
+            end[hits] = column[i];
+            hits++;
+        }
+    }
+    if (hits == 0 || g_stop) {
+        return;
+    }
+    tmto_walk(h, s, x, col, end, hits);
+
+    for (uint32_t i = 0; i < hits; i++) {
+        key_check(x[i]);
+    }
+}
+
+/*
+ * Worker thread
+ * Items go column group by column group, each over all tables, so the
+ * short walks near the chain ends are done first.
+ */
+static void* worker_main(void* arg) {
+    (void)arg;
+    tmto_scratch_t* s = malloc(sizeof(tmto_scratch_t));
+
+    if (!s) {
+        fprintf(stderr, "out of memory\n");
+        return NULL;
+    }
+
+    while (!g_stop) {
+        uint32_t item = __atomic_fetch_add(&g_next_item, 1, __ATOMIC_RELAXED);
+        if (item >= g_num_items) {
+            break;
+        }
+
+        const table_t* t = &g_tables[item % g_num_tables];
+        uint32_t group = item / g_num_tables;
+        if (group < t->groups) {
+            tmto_scratch_init(s, t->header);
+            search_group(t, group, s);
+        }
+    }
+
+    free(s);
+    return NULL;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "usage: tmto_lookup [-j threads] [-a] -f TABLE [-f TABLE ...]\n"
+        "                   UID:CHALLENGE:RESPONSE [UID:CHALLENGE:RESPONSE ...]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char* paths[MAX_TABLES];
+    int num_paths = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:j:a")) != -1) {
+        switch (opt) {
+            case 'f':
+                if (num_paths >= MAX_TABLES) usage();
+                paths[num_paths++] = optarg;
+                break;
+            case 'j': threads = atoi(optarg); break;
+            case 'a': g_find_all = true; break;
+            default: usage();
+        }
+    }
+
+    for (int i = optind; i < argc; i++) {
+        if (g_num_tuples >= MAX_TUPLES || !parse_tuple(argv[i], &g_tuples[g_num_tuples])) {
+            usage();
+        }
+        g_num_tuples++;
+    }
+    if (num_paths == 0 || g_num_tuples == 0) {
+        usage();
+    }
+
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+    uint32_t max_groups = 0;
+    for (int i = 0; i < num_paths; i++) {
+        table_t* t = &g_tables[g_num_tables];
+        if (!table_open(t, paths[i])) {
+            continue;
+        }
+        if (t->header->uid != g_tuples[0].uid || t->header->challenge != g_tuples[0].challenge) {
+            fprintf(stderr, "%s: built for %08X:%08X, skipped\n", paths[i],
+                    t->header->uid, t->header->challenge);
+            munmap((void*)t->header, t->size);
+            continue;
+        }
+        if (t->groups > max_groups) {
+            max_groups = t->groups;
+        }
+        g_num_tables++;
+    }
+    if (g_num_tables == 0) {
+        fprintf(stderr, "no table for %08X:%08X\n", g_tuples[0].uid, g_tuples[0].challenge);
+        return 1;
+    }
+
+    if (g_num_tuples < 2) {
+        fprintf(stderr, "warning: one tuple leaves ~2^16 false positives; add a second\n");
+    }
+
+    crypto_init();
+    g_num_items = max_groups * g_num_tables;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    pthread_t workers[MAX_THREADS];
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&workers[i], NULL, worker_main, NULL);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    fprintf(stderr, "searched %d table%s in %.2f s, %" PRIu64 " false alarms\n",
+            g_num_tables, (g_num_tables == 1) ? "" : "s",
+            (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9, g_false_alarms);
+
+    if (g_num_found == 0) {
+        fprintf(stderr, "no key found\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * Hi-Tag 2 Emulator - Bulk Token Generator
+ * Provisions a site: derives the key of every UID in a range from a
+ * master secret and writes the tokens
+ *
+ * Usage: tokengen [options] -m MASTER FIRST_UID [LAST_UID]
+ *   -m HEX     master secret: the 48-bit value for xor (as keys are
+ *              printed), 32 hex digits (AES key bytes in order) for aes
+ *   -d SCHEME  diversification scheme: aes (default) or xor
+ *   -c SITE    site code in the AES block (hex, default 0)
+ *   -C CONFIG  page 1 of every token (hex, default 0)
+ *   -P PASS    password, lower half of page 3 (hex, default 0)
+ *   -o FILE    output file (default: stdout)
+ *   -t         text output, one "UID KEY" line per token
+ *
+ * The range FIRST_UID..LAST_UID is inclusive (hex, one token if LAST_UID
+ * is omitted). Binary output is the 32-byte token image per UID, back to
+ * back, as LOAD_TOKEN takes it. Keys are printed as the 48-bit value with
+ * key[0] in the low byte, as keysearch prints them.
+ *
+ * UIDs go through keydiv_derive() in batches of TOKENGEN_BATCH and each
+ * batch is written as soon as it is ready, so a whole 2^32 range streams
+ * in constant memory.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "keydiv.h"
+
+#define TOKENGEN_BATCH  4096
+
+/*
+ * Parse a hex number, rejecting trailing garbage
+ */
+static bool parse_hex(const char* text, uint64_t* value) {
+    char* end;
+
+    errno = 0;
+    *value = strtoull(text, &end, 16);
+    return errno == 0 && end != text && *end == '\0';
+}
+
+/*
+ * Parse a master secret of exactly len bytes
+ * Six bytes (xor) are a 48-bit value, key[0] in the low byte; longer
+ * secrets are bytes in order, first byte first.
+ */
+static bool parse_master(const char* text, uint8_t* master, size_t len) {
+    if (strlen(text) != 2 * len) {
+        return false;
+    }
+
+    if (len == 6) {
+        uint64_t value;
+        if (!parse_hex(text, &value)) {
+            return false;
+        }
+        for (int j = 0; j < 6; j++) {
+            master[j] = (value >> (8 * j)) & 0xFF;
+        }
+        return true;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        unsigned int byte;
+        char digits[3] = {text[2 * i], text[2 * i + 1], '\0'};
+        char* end;
+
+        byte = (unsigned int)strtoul(digits, &end, 16);
+        if (*end != '\0') {
+            return false;
+        }
+        master[i] = (uint8_t)byte;
+    }
+    return true;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "usage: tokengen [-d aes|xor] [-c site] [-C config] [-P password] [-o file] [-t]\n"
+        "                -m MASTER FIRST_UID [LAST_UID]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    keydiv_scheme_t scheme = KEYDIV_AES;
+    const char* master_text = NULL;
+    const char* path = NULL;
+    uint64_t site = 0, config = 0, password = 0;
+    bool text = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:d:c:C:P:o:t")) != -1) {
+        switch (opt) {
+            case 'm': master_text = optarg; break;
+            case 'd': if (!keydiv_parse_scheme(optarg, &scheme)) usage(); break;
+            case 'c': if (!parse_hex(optarg, &site) || site > UINT32_MAX) usage(); break;
+            case 'C': if (!parse_hex(optarg, &config) || config > UINT32_MAX) usage(); break;
+            case 'P': if (!parse_hex(optarg, &password) || password > UINT16_MAX) usage(); break;
+            case 'o': path = optarg; break;
+            case 't': text = true; break;
+            default: usage();
+        }
+    }
+
+    uint64_t first, last;
+    if (!master_text || optind >= argc || argc - optind > 2 ||
+        !parse_hex(argv[optind], &first) || first > UINT32_MAX) {
+        usage();
+    }
+    last = first;
+    if (argc - optind == 2 && (!parse_hex(argv[optind + 1], &last) || last > UINT32_MAX ||
+                               last < first)) {
+        usage();
+    }
+
+    uint8_t master[KEYDIV_MAX_MASTER];
+    keydiv_ctx_t ctx;
+    size_t master_len = keydiv_master_len(scheme);
+    if (!parse_master(master_text, master, master_len)) {
+        fprintf(stderr, "master secret must be %zu hex digits for %s\n", 2 * master_len,
+                keydiv_scheme_name(scheme));
+        return 2;
+    }
+    keydiv_init(&ctx, scheme, master, master_len, (uint32_t)site);
+    memset(master, 0, sizeof(master));
+
+    if (!keydiv_self_test()) {
+        fprintf(stderr, "AES self-test failed (%s)\n", keydiv_aes_impl());
+        return 1;
+    }
+
+    FILE* out = stdout;
+    if (path && !(out = fopen(path, "wb"))) {
+        perror(path);
+        return 1;
+    }
+    if (!path && !text && isatty(fileno(stdout))) {
+        fprintf(stderr, "refusing to write binary tokens to a terminal (use -o or -t)\n");
+        return 2;
+    }
+
+    static uint32_t uids[TOKENGEN_BATCH];
+    static hitag2_key_t keys[TOKENGEN_BATCH];
+    static uint8_t images[TOKENGEN_BATCH * KEYDIV_TOKEN_SIZE];
+    uint64_t total = last - first + 1;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    for (uint64_t base = first; base <= last; base += TOKENGEN_BATCH) {
+        uint32_t n = (last - base + 1 < TOKENGEN_BATCH) ? (uint32_t)(last - base + 1) : TOKENGEN_BATCH;
+
+        for (uint32_t i = 0; i < n; i++) {
+            uids[i] = (uint32_t)(base + i);
+        }
+        keydiv_derive(&ctx, uids, keys, n);
+
+        if (text) {
+            for (uint32_t i = 0; i < n; i++) {
+                uint64_t key = 0;
+                for (int j = 0; j < 6; j++) {
+                    key |= (uint64_t)keys[i].bytes[j] << (8 * j);
+                }
+                fprintf(out, "%08" PRIX32 " %012" PRIX64 "\n", uids[i], key);
+            }
+        } else {
+            for (uint32_t i = 0; i < n; i++) {
+                keydiv_token_image(&images[i * KEYDIV_TOKEN_SIZE], uids[i], (uint32_t)config,
+                                   &keys[i], (uint16_t)password);
+            }
+            if (fwrite(images, KEYDIV_TOKEN_SIZE, n, out) != n) {
+                perror(path ? path : "stdout");
+                return 1;
+            }
+        }
+    }
+
+    if (fflush(out) != 0 || (path && fclose(out) != 0)) {
+        perror(path ? path : "stdout");
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    fprintf(stderr, "%" PRIu64 " tokens, %s (%s), %.2f s\n", total, keydiv_scheme_name(scheme),
+            (scheme == KEYDIV_AES) ? keydiv_aes_impl() : "vector", seconds);
+    return 0;
+}